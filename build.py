@@ -1,12 +1,29 @@
-# Run with: python3 build.py
+# Run with: python3 build.py [target]
+#   project  - the interactive SDL/OpenGL program (default)
+#   headless - the display-free physics runner, needs neither SDL nor OpenGL
+#   bench    - times the solver kernels on a range of meshes, prints JSON
+#   tests    - checks the display-free parts, exits with 1 if any fail
 import os
 import platform
+import sys
 
 # (1)==================== COMMON CONFIGURATION OPTIONS ======================= #
 COMPILER="g++ -std=c++17"   # The compiler we want to use
                                 #(You may try g++ if you have trouble)
 SOURCE="./src/*.cpp ./src/core/*.cpp ./src/glad/*.cpp ./src/physics/*.cpp ./src/rendering/*.cpp"    # Where the source code lives
 EXECUTABLE="project"        # Name of the final executable
+OPTIMIZATION="-O3 -fno-math-errno -fno-trapping-math" # Lets the solver loops
+                            # auto-vectorize (sqrt and divides included)
+# The headless runner and the benchmarks only need the simulation sources
+SIMULATION_SOURCE="./src/core/AABB.cpp ./src/core/MeshGenerator.cpp ./src/core/MappedFile.cpp ./src/core/ObjLoader.cpp ./src/core/Profiler.cpp ./src/core/ThreadPool.cpp ./src/core/Transform.cpp ./src/physics/CollisionSystem.cpp ./src/physics/JacobiSolver.cpp ./src/physics/PhysicsWorld.cpp ./src/physics/Scene.cpp ./src/physics/Softbody.cpp ./src/physics/SoftbodyMesh.cpp ./src/physics/SoftbodyMeshCache.cpp ./src/physics/SpatialHash.cpp ./src/physics/TetMesh.cpp ./src/physics/TriangleBVH.cpp"
+HEADLESS_SOURCE="./src/headless/*.cpp "+SIMULATION_SOURCE
+HEADLESS_EXECUTABLE="headless"
+HEADLESS_ARGUMENTS="-D HEADLESS" # Strips out material/texture loading
+BENCH_SOURCE="./src/bench/*.cpp "+SIMULATION_SOURCE
+BENCH_EXECUTABLE="bench"
+TESTS_SOURCE="./src/tests/*.cpp ./src/rendering/SoftbodyRenderStates.cpp ./src/rendering/SoftbodyVertex.cpp "+SIMULATION_SOURCE
+TESTS_EXECUTABLE="tests"
+TARGET=sys.argv[1] if len(sys.argv) > 1 else "project"
 # ======================= COMMON CONFIGURATION OPTIONS ======================= #
 
 # (2)=================== Platform specific configuration ===================== #
@@ -18,7 +35,7 @@ LIBRARIES=""            # What libraries do we want to include
 if platform.system()=="Linux":
     ARGUMENTS="-D LINUX" # -D is a #define sent to preprocessor
     INCLUDE_DIR="-I ./include/ -I ./../common/thirdparty/glm/"
-    LIBRARIES="-lSDL2 -ldl"
+    LIBRARIES="-lSDL2 -ldl -pthread"
 elif platform.system()=="Darwin":
     ARGUMENTS="-D MAC" # -D is a #define sent to the preprocessor.
     INCLUDE_DIR="-I ./include/ -I/Library/Frameworks/SDL2.framework/Headers -I./../common/thirdparty/old/glm"
@@ -28,12 +45,34 @@ elif platform.system()=="Windows":
     ARGUMENTS="-D MINGW -std=c++17 -static-libgcc -static-libstdc++"
     INCLUDE_DIR="-I./include/ -I./../common/thirdparty/old/glm/"
     EXECUTABLE="project.exe"
+    HEADLESS_EXECUTABLE="headless.exe"
+    BENCH_EXECUTABLE="bench.exe"
+    TESTS_EXECUTABLE="tests.exe"
     LIBRARIES="-lmingw32 -lSDL2main -lSDL2 -mwindows"
 # (2)=================== Platform specific configuration ===================== #
 
 # (3)====================== Building the Executable ========================== #
+if TARGET=="headless":
+    SOURCE=HEADLESS_SOURCE
+    EXECUTABLE=HEADLESS_EXECUTABLE
+    ARGUMENTS=ARGUMENTS+" "+HEADLESS_ARGUMENTS
+    LIBRARIES="-pthread"
+elif TARGET=="bench":
+    SOURCE=BENCH_SOURCE
+    EXECUTABLE=BENCH_EXECUTABLE
+    ARGUMENTS=ARGUMENTS+" "+HEADLESS_ARGUMENTS
+    LIBRARIES="-pthread"
+elif TARGET=="tests":
+    SOURCE=TESTS_SOURCE
+    EXECUTABLE=TESTS_EXECUTABLE
+    ARGUMENTS=ARGUMENTS+" "+HEADLESS_ARGUMENTS
+    LIBRARIES="-pthread"
+elif TARGET!="project":
+    print("Unknown target: "+TARGET)
+    sys.exit(1)
+
 # Build a string of our compile commands that we run in the terminal
-compileString="bear -- "+COMPILER+" "+ARGUMENTS+" -o "+EXECUTABLE+" "+" "+INCLUDE_DIR+" "+SOURCE+" "+LIBRARIES
+compileString="bear -- "+COMPILER+" "+OPTIMIZATION+" "+ARGUMENTS+" -o "+EXECUTABLE+" "+" "+INCLUDE_DIR+" "+SOURCE+" "+LIBRARIES
 # Print out the compile string
 # This is the command you can type
 print("============v (Command running on terminal) v===========================")
@@ -16,6 +16,13 @@ struct AABB {
 
   std::vector<glm::vec3> vertices() const;
 
+  // Returns true if the AABBs overlap, both in the same space
+  bool overlaps(const AABB &other) const {
+    return min.x <= other.max.x && max.x >= other.min.x &&
+           min.y <= other.max.y && max.y >= other.min.y &&
+           min.z <= other.max.z && max.z >= other.min.z;
+  }
+
   // Returns true if the AABB intersects with the other AABB
   bool intersects(const AABB &other, const glm::mat4 &otherModelMatrix,
                   const glm::mat4 &thisModelMatrix) const;
@@ -10,13 +10,29 @@
 
 #include "physics/SoftbodyObject.hpp"
 
+class CollisionSystem;
 class Shader;
 
 class Entity {
 public:
   Entity() = default;
 
+  /**
+   * @brief Update the entity and all of its children.
+   * Transforms are propagated parent-before-child, contacts between the
+   * objects are resolved if a collision system is set, then every non-static
+   * object is simulated in parallel.
+   *
+   * @param deltaTime Time since the last update in seconds
+   */
   virtual void update(float deltaTime);
+
+  /**
+   * @brief Draw the entity and all of its children, in the state between the
+   * last two updates that the shader's u_Interpolation picks
+   *
+   * @param shader The shader to draw with
+   */
   virtual void draw(const Shader &shader) const;
 
   /**
@@ -37,6 +53,16 @@ public:
 
   Entity *getParent() { return _parent; }
 
+  /**
+   * @brief Set the collision system used to resolve contacts between the
+   * objects of the entity and its children. Only needed on the root.
+   *
+   * @param collisionSystem The collision system, or nullptr to disable
+   */
+  void setCollisionSystem(CollisionSystem *collisionSystem) {
+    _collisionSystem = collisionSystem;
+  }
+
   /**
    * @brief Set the object of the entity.
    *
@@ -45,7 +71,6 @@ public:
    */
   template <typename... Args> void setObject(Args &&...args) {
     _object = std::make_unique<SoftbodyObject>(std::forward<Args>(args)...);
-    updateAABB();
   }
 
   SoftbodyObject *getObject() { return _object.get(); }
@@ -55,11 +80,12 @@ public:
   void setTransform(const Transform &transform) { _transform = transform; }
 
   /**
-   * @brief Update the AABB of the entity.
-   * This should only be called once after the object has been set.
-   * Too expensive to call every frame.
+   * @brief Get the AABB of the entity in local space.
+   * Kept current by the object, so it is cheap to call every frame.
+   *
+   * @return AABB The AABB of the object, empty without one
    */
-  void updateAABB();
+  AABB getAABB() const;
 
   /**
    * @brief Check if the entity intersects with another entity.
@@ -89,10 +115,22 @@ protected:
   Transform _transform;
 
 private:
+  /**
+   * @brief Compute the model matrices of the entity and its children, and
+   * collect the entities that have objects.
+   *
+   * @param entities Vector to add the entities with objects to
+   */
+  void updateTransforms(std::vector<Entity *> &entities);
+
   std::unique_ptr<SoftbodyObject> _object;
-  AABB _aabb;
+
+  // The model matrix of the state before the last update, for interpolation
+  glm::mat4 _previousModelMatrix = glm::mat4(1.0f);
 
   // Scene graph
   std::vector<std::unique_ptr<Entity>> _children;
   Entity *_parent = nullptr;
+
+  CollisionSystem *_collisionSystem = nullptr;
 };
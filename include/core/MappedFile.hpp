@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A read-only view of a whole file.
+ *
+ * Memory-mapped on Linux and macOS. Elsewhere the file is read into memory
+ * with a single read.
+ */
+class MappedFile {
+public:
+  MappedFile(const std::string &filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool isOpen() const { return _isOpen; }
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  bool _isOpen = false;
+  const char *_data = nullptr;
+  size_t _size = 0;
+
+  bool _isMapped = false;
+  std::vector<char> _buffer; // Only used when the file is not mapped
+};
@@ -2,7 +2,6 @@
 
 #include "rendering/Mesh.hpp"
 
-#include <cstring>
 #include <string>
 #include <vector>
 
@@ -12,6 +11,15 @@
 struct MeshVertex;
 class Texture;
 
+// Which attributes two obj corners have to share to become one vertex
+enum class VertexWeld {
+  // Position, uv and normal. Keeps uv and normal seams.
+  ALL_ATTRIBUTES,
+  // Position only, one vertex per point in space. Seams take the uv of the
+  // first corner and the averaged normal.
+  POSITION_ONLY
+};
+
 class ObjLoader {
 public:
   /**
@@ -22,19 +30,41 @@ public:
   static bool loadMesh(const std::string &filename, Mesh &out_mesh,
                        std::vector<Texture> &out_textures);
 
+  /**
+   * Load only the geometry of the mesh at the given path, skipping materials.
+   * Does not touch OpenGL, so it can be used by headless builds.
+   * @param filename the path to the mesh file
+   * @param out_mesh the loaded mesh
+   * @param weld which corners are merged into one vertex
+   * @return true if the mesh was loaded successfully
+   */
+  static bool loadMesh(const std::string &filename, Mesh &out_mesh,
+                       VertexWeld weld = VertexWeld::ALL_ATTRIBUTES);
+
+  /**
+   * Find the mtl files the obj file at the given path refers to
+   * @param filename the path to the obj file
+   * @param out_files the vector to add the full paths of the mtl files to
+   * @return true if the file was read successfully, false otherwise
+   */
+  static bool findMaterialFiles(const std::string &filename,
+                                std::vector<std::string> &out_files);
+
   /**
    * Load the obj file at the given path into the given vector of vertices
    * @param filename the path to the obj file
    * @param out_vertices the vector to load the vertices into
    * @param out_uvs the vector to load the uvs into
    * @param out_normals the vector to load the normals into
+   * @param out_textures the vector to load the textures into, materials are
+   * skipped if null
    * @return true if the file was loaded successfully, false otherwise
    */
   static bool loadObj(const std::string &filename,
                       std::vector<glm::vec3> &out_vertices,
                       std::vector<glm::vec2> &out_uvs,
                       std::vector<glm::vec3> &out_normals,
-                      std::vector<Texture> &out_textures);
+                      std::vector<Texture> *out_textures);
 
   /**
    * Compute the normals for the given vertices and indices.
@@ -63,12 +93,17 @@ public:
                               std::vector<glm::vec3> &out_bitangents);
 
   /**
-   * Create a single index buffer from the given vertex, uv, and normal data
+   * Create a single index buffer from the given vertex, uv, and normal data.
+   * Attributes are quantized to buckets of 1e-5, and corners whose
+   * quantized attributes are equal share a vertex. With POSITION_ONLY, a
+   * corner also joins a vertex of a neighboring bucket that is within 1e-5
+   * on every axis, so positions either side of a bucket edge still weld.
    * @param in_vertices the vertices
    * @param in_uvs      the uvs
    * @param in_normals  the normals
    * @param out_vertices the final vertex data
    * @param out_indices  the final index data
+   * @param weld which attributes have to match
    * @return true if the index buffer was created successfully, false
    * otherwise
    */
@@ -78,7 +113,8 @@ public:
                        const std::vector<glm::vec3> &in_tangents,
                        const std::vector<glm::vec3> &in_bitangents,
                        std::vector<MeshVertex> &out_vertices,
-                       std::vector<unsigned int> &out_indices);
+                       std::vector<unsigned int> &out_indices,
+                       VertexWeld weld = VertexWeld::ALL_ATTRIBUTES);
 
   /**
    * Load the mtl file at the given path into the given vector of textures
@@ -90,18 +126,13 @@ public:
                       std::vector<Texture> &out_textures);
 
 private:
-  // intermediate structures for loading obj files
-  struct ObjVertex {
-    glm::vec3 position;
-    glm::vec2 uv;
-    glm::vec3 normal;
-    bool operator<(const ObjVertex that) const {
-      return memcmp((void *)this, (void *)&that, sizeof(ObjVertex)) > 0;
-    };
-  };
-  struct ObjFace {
-    unsigned int vertexIndices[3];
-    unsigned int uvIndices[3];
-    unsigned int normalIndices[3];
-  };
+  // Resolves an mtllib entry relative to the directory of the obj file
+  static std::string materialPath(const std::string &filename,
+                                  const std::string &mtlFilename);
+
+  // Shared implementation of loadMesh, materials are skipped if out_textures
+  // is null
+  static bool loadMeshData(const std::string &filename, Mesh &out_mesh,
+                           std::vector<Texture> *out_textures,
+                           VertexWeld weld);
 };
@@ -35,6 +35,10 @@ protected:
 
   virtual unsigned int indicesCount() const = 0;
 
+  // True if the normal attribute holds octahedral-encoded normals that the
+  // vertex shader has to decode
+  virtual bool hasOctahedralNormals() const { return false; }
+
 private:
   std::vector<Texture> _textures;
   // Default color if no textures are loaded
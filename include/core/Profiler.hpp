@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Collects scoped timings and counters to find regressions.
+ *
+ * Disabled by default, then a scope costs a single load. While enabled, every
+ * thread records into a buffer of its own, so the work inside a parallelFor
+ * is timed without taking a lock. endFrame closes a frame: the time spent in
+ * each scope and the values of each counter are summed per frame, and
+ * getStats reports their minimum, average and 99th percentile over all frames.
+ * writeChromeTrace exports the recorded scopes in the Chrome trace event
+ * format, which chrome://tracing and Perfetto open.
+ */
+class Profiler {
+public:
+  // The per-frame totals of a scope in milliseconds, or of a counter
+  struct Stats {
+    std::string name;
+    bool isCounter = false;
+    size_t frames = 0; // Frames the scope ran or the counter changed in
+    double min = 0.0;
+    double average = 0.0;
+    double p99 = 0.0;
+  };
+
+  Profiler() = default;
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool enabled) {
+    _enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Nanoseconds since the profiler was created
+  int64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - _epoch)
+        .count();
+  }
+
+  /**
+   * @brief Records a scope that ran from start to end, both from now().
+   * Usually called by ProfileScope.
+   *
+   * @param name A string that outlives the profiler, usually a literal
+   */
+  void record(const char *name, int64_t start, int64_t end);
+
+  /**
+   * @brief Adds value to a counter of the current frame
+   *
+   * @param name A string that outlives the profiler, usually a literal
+   */
+  void count(const char *name, double value);
+
+  /**
+   * @brief Sums up the scopes and counters recorded since the last call.
+   * Must be called between frames, while no profiled work is in flight.
+   */
+  void endFrame();
+
+  // Forgets all of the recorded frames and trace events
+  void clear();
+
+  std::vector<Stats> getStats() const;
+  void printStats(std::ostream &stream) const;
+
+  /**
+   * @brief Writes the recorded scopes and counters as a Chrome trace.
+   * Scopes of frames that were not ended yet are left out.
+   *
+   * @param filename The JSON file to write
+   * @return bool False if the file could not be written
+   */
+  bool writeChromeTrace(const std::string &filename) const;
+
+  // The profiler used by PROFILE_SCOPE
+  static Profiler &global();
+
+private:
+  struct ScopeEvent {
+    const char *name;
+    int64_t start;
+    int64_t end;
+  };
+  struct CounterEvent {
+    const char *name;
+    int64_t time;
+    double value;
+  };
+  // The events of one thread, only written by that thread
+  struct ThreadBuffer {
+    unsigned int threadId;
+    std::vector<ScopeEvent> scopes;     // Of the current frame
+    std::vector<CounterEvent> counters; // Of the current frame
+    std::vector<ScopeEvent> traceScopes;
+    std::vector<CounterEvent> traceCounters;
+  };
+
+  std::atomic<bool> _enabled{false};
+  const std::chrono::steady_clock::time_point _epoch =
+      std::chrono::steady_clock::now();
+
+  mutable std::mutex _mutex; // Guards _threadBuffers
+  std::vector<std::unique_ptr<ThreadBuffer>> _threadBuffers;
+  ThreadBuffer &threadBuffer();
+
+  // Per-frame totals, by name
+  std::map<std::string, std::vector<double>> _scopeFrames;
+  std::map<std::string, std::vector<double>> _counterFrames;
+};
+
+/**
+ * @brief Times the enclosing scope while the global profiler is enabled
+ */
+class ProfileScope {
+public:
+  explicit ProfileScope(const char *name)
+      : _name(Profiler::global().isEnabled() ? name : nullptr) {
+    if (_name) {
+      _start = Profiler::global().now();
+    }
+  }
+  ~ProfileScope() {
+    if (_name) {
+      Profiler::global().record(_name, _start, Profiler::global().now());
+    }
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  const char *_name;
+  int64_t _start = 0;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope under name
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
@@ -4,6 +4,7 @@
 
 #include "Entity.hpp"
 #include "MeshGenerator.hpp"
+#include "physics/CollisionSystem.hpp"
 #include "physics/Grabber.hpp"
 
 class Window;
@@ -30,6 +31,12 @@ public:
   // Spawns an object of the specified type
   Entity *addObject(MeshGenerator::MeshType type);
 
+  // The time step physics runs at, e.g. 1/120 for 120 Hz
+  float getFixedDeltaTime() const { return _fixedDeltaTime; }
+  void setFixedDeltaTime(float fixedDeltaTime) {
+    _fixedDeltaTime = fixedDeltaTime;
+  }
+
   void getOpenGLVersionInfo();
 
   // initializing a test scene
@@ -43,8 +50,18 @@ private:
   // Stored to prevent a large delta time after delays
   Uint32 _lastTime;
 
+  // Physics runs at a fixed rate independent of the display. Frame time is
+  // collected in the accumulator and spent in whole steps, the remainder
+  // interpolates the rendered state.
+  float _fixedDeltaTime = 1.0f / 60.0f;
+  float _accumulator = 0.0f;
+  // Beyond this many steps in one frame the time is dropped instead, so a
+  // hitch slows the simulation down rather than stalling every later frame
+  static constexpr int MAX_STEPS_PER_FRAME = 8;
+
   // Scene graph and objects
   Entity _rootNode;
+  CollisionSystem _collisionSystem;
 
   // Grabber
   Grabber _grabber;
@@ -56,8 +73,10 @@ private:
       "res/objects/bunny/bunny_centered_fixed.obj";
   inline static const std::string BUNNY_REDUCED_PATH =
       "res/objects/bunny/bunny_centered_reduced_fixed.obj";
+  // Where the P key writes the profiler trace
+  inline static const std::string PROFILE_PATH = "profile.json";
 
   void input(float deltaTime);
   void update(float deltaTime);
-  void render() const;
+  void render(float interpolation) const;
 };
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that help with open parallelFor jobs.
+ *
+ * Threads that wait on a parallelFor help with other open jobs instead of
+ * blocking, so parallelFor can be nested (e.g. per object, then per
+ * constraint color) without deadlocking. Jobs are pooled and refer to the
+ * callable of their caller, so a parallelFor does not allocate once the pool
+ * has seen its deepest nesting.
+ */
+class ThreadPool {
+public:
+  /**
+   * @brief Create a pool.
+   *
+   * @param threadCount Total number of threads that run work, including the
+   * calling thread. 0 picks one per hardware thread.
+   */
+  ThreadPool(unsigned int threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Total number of threads that run work, including the calling thread
+  unsigned int getThreadCount() const { return _workers.size() + 1; }
+
+  /**
+   * @brief Restart the pool with a different number of threads.
+   * Must not be called while work is in flight.
+   *
+   * @param threadCount Total number of threads, 0 picks one per hardware
+   * thread
+   */
+  void setThreadCount(unsigned int threadCount);
+
+  /**
+   * @brief Split [0, count) into chunks and run func(begin, end) on each,
+   * returning once every chunk has finished. The calling thread runs chunks
+   * too. Runs inline if count is not larger than grainSize.
+   *
+   * @param count Number of items
+   * @param grainSize Minimum number of items per chunk
+   * @param func Called with the half-open range of items to process, must
+   * be callable as const
+   */
+  template <typename Func>
+  void parallelFor(size_t count, size_t grainSize, const Func &func) {
+    runParallelFor(
+        count, grainSize,
+        [](const void *context, size_t begin, size_t end) {
+          (*static_cast<const Func *>(context))(begin, end);
+        },
+        &func);
+  }
+
+  // The pool shared by the engine
+  static ThreadPool &global();
+
+private:
+  using RangeFunction = void (*)(const void *context, size_t begin,
+                                 size_t end);
+  struct Job;
+
+  std::vector<std::thread> _workers;
+  // Jobs that still have chunks nobody claimed, the newest last
+  std::vector<Job *> _openJobs;
+  // Every job ever needed, and the ones no thread refers to anymore
+  std::vector<std::unique_ptr<Job>> _jobs;
+  std::vector<Job *> _freeJobs;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stopping = false;
+
+  void start(unsigned int threadCount);
+  void stop();
+  void workerLoop();
+
+  void runParallelFor(size_t count, size_t grainSize, RangeFunction func,
+                      const void *context);
+  // Runs chunks of the newest open job, returns false if there was none
+  bool helpOpenJob();
+  // Once every chunk of a job is claimed nobody else needs to find it. The
+  // caller must hold _mutex.
+  void closeJob(Job *job);
+  // Drops a reference to the job, the caller must hold _mutex
+  void releaseJob(Job *job);
+};
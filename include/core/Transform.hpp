@@ -12,7 +12,6 @@
 
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/vec3.hpp"
-#include <glad/glad.h>
 
 // The purpose of this class is to store
 // transformations of 3D entities (cameras, objects, etc.)
@@ -25,7 +24,7 @@ public:
 
   // Returns the transformation matrix
   glm::mat4 getModelMatrix() const;
-  GLfloat *getMatrixPtr();
+  float *getMatrixPtr();
 
   glm::vec3 getPosition() const;
   glm::vec3 getRotation() const; // Returns the rotation in degrees
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "core/AABB.hpp"
+#include "physics/SpatialHash.hpp"
+
+class Softbody;
+
+// A softbody taking part in collision, and the model matrix its positions
+// are relative to
+struct CollisionBody {
+  Softbody *softbody;
+  glm::mat4 modelMatrix;
+};
+
+/**
+ * @brief Finds the contacts between softbodies.
+ *
+ * A spatial hash over the world bounding boxes finds the pairs that may touch,
+ * and only those pairs run the vertex-triangle narrow phase. Every point mass
+ * that is inside, or could reach during the coming step, a face of the other
+ * body gets a contact plane, and so do the point masses of that face. The
+ * bodies enforce their planes while they are stepped, so stepping stays
+ * independent per body. Static bodies give contacts but never receive them.
+ *
+ * Touching dynamic bodies form islands. An island falls asleep once all of its
+ * bodies are calm, and wakes up as soon as one of them is not, so a body at
+ * rest on another one never sleeps while the other is still moving. Pairs
+ * without an awake dynamic body skip the narrow phase.
+ */
+class CollisionSystem {
+public:
+  /**
+   * @brief Replaces the contacts of all of the bodies
+   *
+   * @param bodies The bodies to collide, their model matrices must be current
+   * @param deltaTime The time step the bodies are about to be advanced by
+   */
+  void resolve(const std::vector<CollisionBody> &bodies, float deltaTime);
+
+  // Distance kept between a point mass and the faces of other bodies
+  float thickness{0.02f};
+  // How deep below a face a point mass may be and still be pushed out through
+  // it, relative to the size of the other body. Deeper tests mistake thin
+  // features for penetration.
+  float maxPenetration{0.05f};
+
+private:
+  SpatialHash _broadPhase;
+  SpatialHash _faceHash;
+
+  // Scratch buffers, kept to avoid allocating every frame
+  std::vector<AABB> _bodyBoxes;
+  std::vector<float> _margins; // Distance each body can move this step
+  std::vector<std::pair<unsigned int, unsigned int>> _pairs;
+  std::vector<std::vector<glm::vec3>> _worldPositions; // Of transformed bodies
+  // The world positions of each body, null until needed
+  std::vector<const std::vector<glm::vec3> *> _bodyPositions;
+  std::vector<AABB> _faceBoxes;
+  std::vector<unsigned int> _faceIndices;
+  std::vector<unsigned int> _hits;
+  std::vector<unsigned int> _islandParents;
+  std::vector<bool> _islandCalm;
+
+  // Finds the pairs of bodies whose boxes, grown by how far they can move
+  // this step, overlap
+  void findPairs(const std::vector<CollisionBody> &bodies, float deltaTime);
+  // Puts the islands of touching bodies to sleep or wakes them up
+  void updateIslands(const std::vector<CollisionBody> &bodies);
+  unsigned int findIsland(unsigned int index);
+
+  // Ensures the world positions of the body are in _bodyPositions
+  void toWorldSpace(const std::vector<CollisionBody> &bodies,
+                    unsigned int index);
+  // Finds the contacts of the point masses of body a with the faces of body b
+  void collide(const std::vector<CollisionBody> &bodies, unsigned int a,
+               unsigned int b);
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+struct SoftbodyMesh;
+
+// Two point distance constraints stored as contiguous arrays so the solve can
+// run as wide SIMD batches
+struct DistanceConstraintBatch {
+  std::vector<unsigned int> indices0;
+  std::vector<unsigned int> indices1;
+  std::vector<float> invMasses0;
+  std::vector<float> invMasses1;
+  std::vector<float> restLengths;
+  std::vector<float> lambdas;
+
+  // Per point mass list of the constraints touching it, in CSR form.
+  // Each entry is (constraint index << 1) | side, side 1 means indices1.
+  std::vector<unsigned int> pointMassOffsets;
+  std::vector<unsigned int> pointMassConstraints;
+
+  size_t size() const { return restLengths.size(); }
+
+  void add(unsigned int i0, unsigned int i1, float restLength,
+           const std::vector<float> &invMasses);
+
+  // Builds the per point mass constraint lists, call after every add
+  void buildAdjacency(size_t pointMassCount);
+};
+
+/**
+ * @brief Jacobi-style XPBD solver for distance constraints.
+ *
+ * Every constraint computes its correction from the same positions, the
+ * corrections are then averaged per point mass and applied with
+ * over-relaxation. Unlike Gauss-Seidel there is no ordering dependence, which
+ * trades convergence per iteration for throughput on very large meshes.
+ */
+class JacobiSolver {
+public:
+  JacobiSolver() = default;
+  JacobiSolver(const SoftbodyMesh &mesh);
+
+  void resetLambdas();
+
+  // Solves the edge length constraints
+  void solveLengths(SoftbodyMesh &mesh, float alpha);
+  // Solves the span (bending) constraints
+  void solveSpans(SoftbodyMesh &mesh, float alpha);
+
+  // Scales the averaged corrections, values above 1 speed up convergence
+  float relaxation{1.5f};
+
+private:
+  DistanceConstraintBatch _lengths;
+  DistanceConstraintBatch _spans;
+
+  // Scratch buffers, one entry per constraint
+  std::vector<float> _dx;
+  std::vector<float> _dy;
+  std::vector<float> _dz;
+
+  void solve(DistanceConstraintBatch &batch, SoftbodyMesh &mesh, float alpha);
+};
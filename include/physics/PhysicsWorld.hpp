@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core/Transform.hpp"
+
+#include "physics/CollisionSystem.hpp"
+#include "physics/Softbody.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A softbody and the transform it is simulated in.
+ */
+struct PhysicsBody {
+  Softbody softbody;
+  Transform transform;
+};
+
+/**
+ * @brief Steps a set of softbodies at a fixed time step.
+ * Contacts between the bodies are resolved at the start of every step.
+ *
+ * Has no dependency on SDL or OpenGL. Given the same bodies and the same
+ * number of steps the results are reproducible bit-for-bit.
+ */
+class PhysicsWorld {
+public:
+  PhysicsWorld(float fixedDeltaTime = 1.0f / 60.0f)
+      : _fixedDeltaTime(fixedDeltaTime){};
+
+  /**
+   * @brief Add a softbody to the world.
+   *
+   * @tparam Args
+   * @param args Arguments to pass to the softbody constructor
+   * @return The newly added body
+   */
+  template <typename... Args> PhysicsBody *addBody(Args &&...args) {
+    PhysicsBody *body =
+        _bodies
+            .emplace_back(std::make_unique<PhysicsBody>(
+                PhysicsBody{Softbody(std::forward<Args>(args)...), Transform()}))
+            .get();
+    return body;
+  }
+
+  void removeBody(PhysicsBody *body);
+
+  /**
+   * @brief Advance every body by one fixed time step
+   */
+  void step();
+
+  /**
+   * @brief Advance every body by the given number of fixed time steps
+   *
+   * @param steps Number of steps to run
+   */
+  void step(int steps);
+
+  float getFixedDeltaTime() const { return _fixedDeltaTime; }
+  void setFixedDeltaTime(float fixedDeltaTime) {
+    _fixedDeltaTime = fixedDeltaTime;
+  }
+
+  // Number of steps taken since the world was created
+  unsigned long getStepCount() const { return _stepCount; }
+  // Simulated time in seconds
+  double getTime() const { return _stepCount * (double)_fixedDeltaTime; }
+
+  std::vector<std::unique_ptr<PhysicsBody>> &getBodies() { return _bodies; }
+  const std::vector<std::unique_ptr<PhysicsBody>> &getBodies() const {
+    return _bodies;
+  }
+
+private:
+  float _fixedDeltaTime;
+  unsigned long _stepCount = 0;
+
+  std::vector<std::unique_ptr<PhysicsBody>> _bodies;
+
+  CollisionSystem _collisionSystem;
+  std::vector<CollisionBody> _collisionBodies;
+};
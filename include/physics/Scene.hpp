@@ -0,0 +1,134 @@
+#pragma once
+
+#include "physics/Softbody.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PhysicsWorld;
+struct PhysicsBody;
+
+// A body of a scene and how it is set up
+struct SceneBody {
+  std::string name;
+  // cube, icosahedron, tetrahedron, plane, bunny, bunny_reduced or a path to
+  // an obj file
+  std::string mesh;
+
+  glm::vec3 position{0.0f};
+  glm::vec3 rotation{0.0f}; // In degrees
+  glm::vec3 scale{1.0f};
+
+  bool isStatic = false;
+  bool isSleepingEnabled = true;
+  // Cells along the longest side when filled with tets, 0 keeps the surface
+  int tetResolution = 0;
+  SolverType solverType = SolverType::GAUSS_SEIDEL;
+  SubstepSettings substepSettings;
+
+  // Negative values keep the compliances the mesh was built with
+  float distanceCompliance = -1.0f;
+  float volumeCompliance = -1.0f;
+  float bendingCompliance = -1.0f;
+  float pressure = -1.0f;
+};
+
+enum class SceneEventType { SPAWN, GRAB, DRAG, RELEASE, REMOVE };
+
+// Something that happens to a body right before the given step
+struct SceneEvent {
+  unsigned long step = 0;
+  SceneEventType type = SceneEventType::SPAWN;
+  SceneBody body; // The body to spawn, only its name for the other events
+  glm::vec3 point{0.0f};     // Grab ray origin, or the point to drag to
+  glm::vec3 direction{0.0f}; // Grab ray direction
+};
+
+/**
+ * @brief A reproducible setup of a PhysicsWorld, read from a scene file.
+ *
+ * Scene files are plain text, one statement per line, # starts a comment:
+ *
+ *   dt 0.0166667
+ *   steps 600
+ *   body floor cube position 0 -0.5 0 scale 20 1 20 static
+ *   body box cube position 0 3 0 distance_compliance 0.0001
+ *   at 120 body bunny bunny_reduced position 0 5 0 substeps adaptive
+ *   at 180 body jelly bunny_reduced position 3 5 0 tetrahedral 12
+ *   at 240 grab box 0 3 5 0 0 -1
+ *   at 250 drag box 0 4 1
+ *   at 300 release box
+ *   at 400 remove bunny
+ *
+ * A body takes the options position, rotation and scale (three numbers
+ * each), static, sleep 0|1, solver gauss_seidel|jacobi, substeps N|adaptive,
+ * iterations N, tetrahedral N (fill the body with tets, N cells along its
+ * longest side), distance_compliance, volume_compliance, bending_compliance
+ * and pressure. Events happen right before the numbered step, counted from 0.
+ */
+class Scene {
+public:
+  /**
+   * @brief Reads a scene file
+   *
+   * @param filename The path to the scene file
+   * @throws std::runtime_error If the file cannot be read or is malformed,
+   * with the line at fault in the message
+   */
+  static Scene load(const std::string &filename);
+
+  // Adds a body with the given mesh name to the world
+  static PhysicsBody *spawn(PhysicsWorld &world, const std::string &mesh);
+
+  float deltaTime = 1.0f / 60.0f;
+  int steps = 600;
+  std::vector<SceneBody> bodies;
+  std::vector<SceneEvent> events; // Ordered by step
+
+  /**
+   * @brief Adds the bodies of the scene to an empty world and rewinds the
+   * events
+   */
+  void start(PhysicsWorld &world);
+
+  /**
+   * @brief Runs the events due before the next step, then steps the world
+   */
+  void step(PhysicsWorld &world);
+
+private:
+  std::unordered_map<std::string, PhysicsBody *> _bodiesByName;
+  size_t _nextEvent = 0;
+
+  void addBody(PhysicsWorld &world, const SceneBody &body);
+  // The body of the event, throws if there is none by that name
+  PhysicsBody &findBody(const std::string &name) const;
+};
+
+/**
+ * @brief The world positions of every point mass of a PhysicsWorld.
+ *
+ * Saved as text, so snapshots can be compared across machines. Used as the
+ * golden state a replayed scene has to end up in.
+ */
+struct WorldSnapshot {
+  std::vector<std::vector<glm::vec3>> bodies;
+
+  static WorldSnapshot capture(const PhysicsWorld &world);
+
+  // Returns false if the file cannot be written
+  bool save(const std::string &filename) const;
+  // Returns false if the file cannot be read or is not a snapshot
+  bool load(const std::string &filename);
+
+  /**
+   * @brief The largest distance between matching point masses of the two
+   * snapshots
+   *
+   * @return float Infinity if the bodies or their point masses do not match
+   */
+  float maxDeviation(const WorldSnapshot &other) const;
+};
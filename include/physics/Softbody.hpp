@@ -0,0 +1,255 @@
+#pragma once
+
+#include "core/AABB.hpp"
+
+#include "physics/JacobiSolver.hpp"
+#include "physics/SoftbodyMesh.hpp"
+#include "physics/TetMesh.hpp"
+#include "physics/TriangleBVH.hpp"
+
+#include <string>
+#include <vector>
+
+struct Ray;
+
+class Transform;
+
+// How the distance constraints are solved
+enum class SolverType {
+  // In place, one graph color at a time. Converges fastest per iteration.
+  GAUSS_SEIDEL,
+  // Averaged corrections from the same positions. Highest throughput on very
+  // large meshes.
+  JACOBI
+};
+
+// How an update is split into substeps
+struct SubstepSettings {
+  // Substeps per update, used unless adaptive is set
+  int substeps = 10;
+  // Constraint solver passes per substep
+  int iterations = 1;
+
+  // Pick the substep count every update so that no point mass travels more
+  // than a fraction of the mean edge length per substep
+  bool adaptive = false;
+  int minSubsteps = 2;
+  int maxSubsteps = 20;
+};
+
+// A plane in world space a point mass has to stay in front of during the
+// next update, dot(normal, position) >= offset
+struct SoftbodyContact {
+  unsigned int pointMassIndex;
+  glm::vec3 normal;
+  float offset;
+};
+
+/**
+ * @brief The simulation state of a single softbody.
+ *
+ * Holds everything needed to step the XPBD solver and nothing needed to render
+ * it, so it can be used without a window or an OpenGL context.
+ *
+ * The positions are relative to the transform of the owner. Static bodies
+ * keep their mesh and transform as they are, dynamic bodies move their point
+ * masses to world space on their first update and leave an identity
+ * transform behind.
+ *
+ * A volumetric softbody fills its surface with tets and simulates those
+ * instead, each tet keeping its own volume. The surface is skinned to the
+ * tets at the end of every update, so everything outside the solver keeps
+ * working with the surface.
+ */
+class Softbody {
+public:
+  Softbody() = default;
+  Softbody(const SoftbodyMesh &softbodyMesh);
+  Softbody(const Mesh &mesh);
+  Softbody(const std::string &filename);
+
+  /**
+   * @brief Advances the simulation by deltaTime
+   *
+   * @param deltaTime The time step in seconds
+   * @param transform The transform of the owning entity. The point masses of
+   * a dynamic softbody are kept in world space, so any transform set on it is
+   * applied to them and then reset to identity.
+   */
+  void update(float deltaTime, Transform &transform);
+
+  bool isStatic() const { return _isStatic; }
+  void setStatic(bool isStatic) { _isStatic = isStatic; }
+
+  bool isVolumetric() const { return !_tetMesh.tets.empty(); }
+  /**
+   * @brief Switches between simulating the surface, held in shape by its
+   * edges and one volume constraint over the whole body, and simulating tets
+   * that fill it. Tets keep large and concave bodies from sagging and solve
+   * in parallel, the Jacobi solver and the bending compliance only apply to
+   * surfaces.
+   *
+   * @param volumetric True to fill the surface with tets as it is now
+   * @param resolution Cells along the longest side of the surface, see TetMesh
+   */
+  void setVolumetric(bool volumetric,
+                     int resolution = TetMesh::DEFAULT_RESOLUTION);
+  const TetMesh &getTetMesh() const { return _tetMesh; }
+
+  SolverType getSolverType() const { return _solverType; }
+  void setSolverType(SolverType solverType);
+
+  const SubstepSettings &getSubstepSettings() const { return _substepSettings; }
+  void setSubstepSettings(const SubstepSettings &substepSettings) {
+    _substepSettings = substepSettings;
+  }
+  // The number of substeps the last update was split into
+  int getLastSubstepCount() const { return _lastSubstepCount; }
+
+  // Contacts with other bodies, enforced during every substep of the next
+  // update. Filled by the CollisionSystem.
+  const std::vector<SoftbodyContact> &getContacts() const { return _contacts; }
+  void addContact(const SoftbodyContact &contact) {
+    _contacts.push_back(contact);
+  }
+  void clearContacts() { _contacts.clear(); }
+
+  // Sleeping bodies are skipped by update until something wakes them. The
+  // CollisionSystem puts whole groups of touching bodies to sleep at once.
+  bool isSleeping() const { return _isSleeping; }
+  // True once the body has barely moved for a while, it may go to sleep
+  bool isCalm() const;
+  // Stops the body and skips its updates
+  void sleep();
+  // Resumes the updates, the body has to calm down again before it can sleep
+  void wake();
+
+  bool isSleepingEnabled() const { return _isSleepingEnabled; }
+  void setSleepingEnabled(bool isSleepingEnabled);
+
+  void applyForce(const glm::vec3 &force);
+  void accelerate(const glm::vec3 &acceleration);
+
+  /**
+   * @brief The axis-aligned bounding box of the point masses, in the space of
+   * the owning transform. Refit at the end of every update, so it is always
+   * current.
+   *
+   * @return AABB The axis-aligned bounding box
+   */
+  const AABB &getAABB() const { return _aabb; }
+
+  /**
+   * @brief Attempts to grab the closest face on the softbody that intersects
+   * the ray and modifies the ray t value.
+   *
+   * @param ray The ray to intersect with
+   * @param modelMatrix The model matrix of the object
+   * @return bool True if a face was grabbed
+   */
+  bool grab(Ray &ray, const glm::mat4 &modelMatrix);
+
+  void updateGrabPoint(const glm::vec3 &grabPoint) { _grabPoint = grabPoint; };
+
+  /**
+   * @brief Releases the grabbed face
+   */
+  void release() { _grabbedFaceIdx = -1; };
+
+  /**
+   * @brief Recalculates the vertex normals from the current positions,
+   * gathering the face normals around each point mass in parallel.
+   * Only needed for rendering.
+   */
+  void updateNormals();
+
+  const SoftbodyMesh &getMesh() const { return _softbodyMesh; }
+  SoftbodyMesh &getMesh() { return _softbodyMesh; }
+
+private:
+  SoftbodyMesh _softbodyMesh;
+  TetMesh _tetMesh; // Empty unless the body is volumetric
+
+  bool _isStatic = false;
+
+  SolverType _solverType = SolverType::GAUSS_SEIDEL;
+  JacobiSolver _jacobiSolver; // Only built when the Jacobi solver is used
+
+  SubstepSettings _substepSettings;
+  int _lastSubstepCount = 0;
+  float _meanEdgeLength = 0.0f; // Rest length, for adaptive substepping
+  // Picks the substep count of the next update of deltaTime
+  int chooseSubstepCount(float deltaTime) const;
+
+  std::vector<SoftbodyContact> _contacts;
+
+  // Sleeping information
+  bool _isSleeping = false;
+  bool _isSleepingEnabled = true;
+  std::vector<glm::vec3> _sleepSnapshot; // World positions at the window start
+  float _sleepWindowTime = 0.0f;
+  int _calmWindows = 0; // Consecutive windows the body barely moved in
+  // Measures the motion since the last window, positions must be in world
+  // space
+  void updateCalmness(float deltaTime);
+
+  AABB _aabb;
+  // Recalculates _aabb from scratch. update refits it on its own, in the
+  // last postSolve or while skinning the surface to the tets.
+  void calculateAABB();
+
+  // Sets up the state derived from the mesh, called by every constructor
+  void initialize();
+
+  // Grabbing information
+  int _grabbedFaceIdx = -1;
+  glm::vec3 _grabPoint;        // The point where the face was grabbed.
+  float _grabRestDistances[3]; // Rest distances from the initial grabbed
+                               // point to the vertices of the grabbed face.
+  float _grabLengthLambdas[3]; // Lambda values for the distance constraints.
+
+  void moveGrabbed(float deltaTime);
+
+  // Faces for picking, refit lazily after the positions change
+  TriangleBVH _bvh;
+  bool _bvhDirty = true;
+
+  // Simulation helpers
+  void preSolve(float deltaTime);
+  void solveConstraints(float deltaTime);
+  void handleCollision();
+  // Refits _aabb on the way if refitAABB is set, for the last substep of an
+  // update
+  void postSolve(float deltaTime, bool refitAABB);
+
+  // Physics helpers
+  // p0 and p1 are positions, w0 and w1 their inverse masses
+  void solveDistanceConstraints(glm::vec3 &p0, float w0, glm::vec3 &p1,
+                                float w1, float restLength,
+                                float &lambdaLength, float alpha);
+  // Solves the length constraints of the edges, or the span constraints if
+  // span is true, one color at a time
+  void solveEdgeConstraints(const ConstraintColoring &coloring, bool span,
+                            float alpha);
+  // Gathers the volume gradient around each point mass, sums the volume on
+  // the way, then moves every point mass along its gradient
+  void solveVolumeConstraint(float deltaTime);
+  // Scratch storage of solveVolumeConstraint, kept to avoid reallocating it
+  // every substep
+  std::vector<glm::vec3> _volumeGradients;
+  std::vector<glm::vec2> _volumeBlockSums; // Volume times 3, denominator
+  std::vector<glm::vec3> _faceNormals;     // Scratch storage of updateNormals
+  // void solveBendingConstraints(float deltaTime);
+
+  // Solves the tet edge and then the tet volume constraints, one color at a
+  // time
+  void solveTetConstraints(float deltaTime);
+  // Moves the surface point masses to where the tets they are embedded in
+  // put them, and refits _aabb around them
+  void skinSurface();
+  std::vector<AABB> _skinBlockBounds; // Scratch storage of skinSurface
+
+  // Calculates the angle between two normals accounting for the signs
+  // float calculateAngle(glm::vec3 nL, glm::vec3 nR, glm::vec3 eM,
+  //                      float &arcCosSign);
+};
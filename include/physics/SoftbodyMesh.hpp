@@ -1,24 +1,19 @@
 #pragma once
 
+#include <array>
+#include <utility>
 #include <vector>
 
 #include <glm/glm.hpp>
 
 #include "rendering/Mesh.hpp"
 
-struct PointMass {
-  glm::vec3 position{0.0f};
-  glm::vec3 prevPosition{0.0f};
-  glm::vec3 velocity{0.0f};
-  float invMass{0.0f};
-
-  glm::vec2 uv{-1.0f};    // For rendering
-  glm::vec3 normal{0.0f}; // For rendering
-};
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+              "glm::vec3 must be tightly packed");
 
 struct SoftbodyEdge {
   unsigned int pointMassIndices[2];
-  unsigned int faceIndices[2];
+  unsigned int faceIndices[2]; // Both the same on a boundary edge
   unsigned int neighborIndices[2]; // Indices of the two points on the faces
                                    // that are not part of the edge
 
@@ -29,12 +24,97 @@ struct SoftbodyEdge {
   float lambdaLength{0.0f};
   float lambdaSpanLength{0.0f};
   // float lambdaAngle{0.0f};
+
+  // Boundary edges have a single face, their span constraint is a no-op
+  bool isBoundary() const { return faceIndices[0] == faceIndices[1]; }
 };
 
 struct SoftbodyFace {
   unsigned int pointMassIndices[3];
 };
 
+// Half-edge adjacency of the faces. Half-edge 3 * f + j belongs to face f and
+// runs from its corner j to its corner (j + 1) % 3.
+struct HalfEdgeAdjacency {
+  static constexpr unsigned int NONE = ~0u;
+
+  // The opposite half-edge, NONE on the boundary. Faces past the second one
+  // on a non-manifold edge get no twin.
+  std::vector<unsigned int> twins;
+  // The edge each half-edge belongs to
+  std::vector<unsigned int> edgeIndices;
+  // The first half-edge of every edge, in the order the edges were found
+  std::vector<unsigned int> edgeHalfEdges;
+
+  size_t edgeCount() const { return edgeHalfEdges.size(); }
+
+  static unsigned int face(unsigned int halfEdge) { return halfEdge / 3; }
+  static unsigned int next(unsigned int halfEdge) {
+    return halfEdge - halfEdge % 3 + (halfEdge + 1) % 3;
+  }
+  static unsigned int prev(unsigned int halfEdge) {
+    return halfEdge - halfEdge % 3 + (halfEdge + 2) % 3;
+  }
+
+  /**
+   * @brief Matches the half-edges in linear time through an open addressing
+   * hash table keyed on the sorted point mass pair
+   *
+   * @param faces The faces to build the adjacency of
+   */
+  void build(const std::vector<SoftbodyFace> &faces);
+};
+
+// The corners of the faces grouped by point mass, in compressed sparse row
+// form, so sums over the faces around each point mass can be gathered in
+// parallel without two threads writing the same point mass
+struct CornerAdjacency {
+  // Point mass i owns [offsets[i], offsets[i + 1]) of oppositeEdges
+  std::vector<unsigned int> offsets{0};
+  // The other two point masses of the face of every corner, in winding order
+  std::vector<std::pair<unsigned int, unsigned int>> oppositeEdges;
+  // The face of every corner
+  std::vector<unsigned int> faceIndices;
+
+  /**
+   * @brief Buckets the corners by point mass with a counting sort
+   *
+   * @param faces The faces to build the adjacency of
+   * @param pointMassCount The number of point masses the faces index
+   */
+  void build(const std::vector<SoftbodyFace> &faces, size_t pointMassCount);
+};
+
+// Groups constraints into colors where no two constraints of the same color
+// share a point mass, so every constraint of a color can be solved in parallel
+struct ConstraintColoring {
+  // Constraint indices sorted by color
+  std::vector<unsigned int> constraintIndices;
+  // Color c spans [colorOffsets[c], colorOffsets[c + 1]) of constraintIndices
+  std::vector<unsigned int> colorOffsets{0};
+
+  size_t colorCount() const { return colorOffsets.size() - 1; }
+
+  /**
+   * @brief Greedily colors a set of two point constraints
+   *
+   * @param pointMassIndices The two point masses of each constraint
+   * @param pointMassCount The number of point masses in the mesh
+   */
+  void build(const std::vector<std::pair<unsigned int, unsigned int>>
+                 &pointMassIndices,
+             size_t pointMassCount);
+
+  /**
+   * @brief Greedily colors a set of four point constraints
+   *
+   * @param pointMassIndices The four point masses of each constraint
+   * @param pointMassCount The number of point masses in the mesh
+   */
+  void build(const std::vector<std::array<unsigned int, 4>> &pointMassIndices,
+             size_t pointMassCount);
+};
+
 struct SoftbodyMesh {
   SoftbodyMesh() = default;
   SoftbodyMesh(const Mesh &mesh);
@@ -42,11 +122,32 @@ struct SoftbodyMesh {
   float calculateVolume() const;
   glm::vec3 getCenter() const;
 
-  std::vector<PointMass> pointMasses;
+  size_t pointMassCount() const { return positions.size(); }
+
+  // Point masses are stored as a structure of arrays so the solver loops only
+  // stream the state they touch. glm::vec3 is tightly packed, so each array
+  // can also be walked as a flat array of 3 * pointMassCount() floats.
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> prevPositions;
+  std::vector<glm::vec3> velocities;
+  std::vector<float> invMasses;
+
+  std::vector<glm::vec2> uvs;     // For rendering
+  std::vector<glm::vec3> normals; // For rendering
+
   std::vector<SoftbodyEdge> edges;
   std::vector<SoftbodyFace> faces;
+  HalfEdgeAdjacency halfEdges;
+  CornerAdjacency corners; // Derived from faces, not stored in the cache
+
+  // Colorings of the edge length and the span (bending) constraints
+  ConstraintColoring lengthColoring;
+  ConstraintColoring spanColoring;
 
   float restVolume{0.0f};
+  // 1 if the faces wind counter-clockwise seen from outside, -1 otherwise.
+  // Multiply face normals by it to make them point outwards.
+  float faceOrientation{1.0f};
   float lambdaVolume{0.0f};
 
   // Inverse stiffnesses (1/k)
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SoftbodyMesh;
+
+/**
+ * @brief Binary cache of the finished SoftbodyMesh built from a mesh file.
+ *
+ * The cache lives next to the source as <filename>.sbmesh. It is a fixed
+ * header followed by 8-byte aligned arrays at the offsets listed in the
+ * header, so it is memory-mapped and copied out array by array. A cache is
+ * only used if its format version and the size and modification time of the
+ * source file all match, otherwise the mesh is rebuilt and the cache
+ * rewritten. Checking them does not read the source.
+ */
+class SoftbodyMeshCache {
+public:
+  // Bump whenever the layout or the way SoftbodyMesh is built changes
+  static constexpr uint32_t VERSION = 4;
+
+  /**
+   * @brief Loads the softbody mesh of the file from its cache, building and
+   * caching it first if the cache is missing or stale
+   *
+   * @param filename The path to the obj file
+   * @param out_mesh The loaded softbody mesh
+   * @param out_materialFiles The full paths of the mtl files of the obj
+   */
+  static void loadOrBuild(const std::string &filename, SoftbodyMesh &out_mesh,
+                          std::vector<std::string> &out_materialFiles);
+
+  /**
+   * @brief Loads the softbody mesh of the file from its cache
+   *
+   * @return bool False if there is no cache or it does not match the file
+   */
+  static bool load(const std::string &filename, SoftbodyMesh &out_mesh,
+                   std::vector<std::string> &out_materialFiles);
+
+  /**
+   * @brief Writes the cache of the file
+   *
+   * @return bool False if the cache could not be written
+   */
+  static bool save(const std::string &filename, const SoftbodyMesh &mesh,
+                   const std::vector<std::string> &materialFiles);
+
+  static std::string cachePath(const std::string &filename) {
+    return filename + ".sbmesh";
+  }
+
+private:
+  // The size and modification time of the file, false if it does not exist
+  static bool statFile(const std::string &filename, uint64_t &out_size,
+                       int64_t &out_time);
+};
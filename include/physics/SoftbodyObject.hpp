@@ -2,7 +2,9 @@
 
 #include "core/Object.hpp"
 
-#include "physics/SoftbodyMesh.hpp"
+#include "physics/Softbody.hpp"
+
+#include "rendering/SoftbodyRenderStates.hpp"
 
 #include <string>
 
@@ -10,6 +12,13 @@ struct Ray;
 
 struct AABB;
 
+/**
+ * @brief A renderable softbody.
+ *
+ * Wraps the simulation state of a Softbody. Its render attributes are only
+ * gathered into the vertex buffer when it is drawn, at most once per frame
+ * however many steps were simulated.
+ */
 class SoftbodyObject : public Object {
 public:
   SoftbodyObject(const SoftbodyMesh &softbodyMesh,
@@ -19,71 +28,75 @@ public:
 
   virtual void update(float deltaTime, Transform &transform) override;
 
-  bool isStatic() const { return _isStatic; }
-  void setStatic(bool isStatic) { _isStatic = isStatic; }
+  /**
+   * @brief Runs the simulation step and marks the render data stale. Touches
+   * no shared state, so different objects can be simulated in parallel.
+   */
+  void simulate(float deltaTime, Transform &transform);
+
+  /**
+   * @brief Brings the GPU buffers up to date with the steps simulated since
+   * the last call: recalculates the normals, gathers the vertices and uploads
+   * them, along with the state before the last step if several were taken.
+   * Does nothing if no step was taken. Called right before drawing, so
+   * bodies that are not drawn never pay for it. Must be called from the
+   * thread that owns the OpenGL context.
+   */
+  void updateBuffers();
 
-  void applyForce(const glm::vec3 &force);
-  void accelerate(const glm::vec3 &acceleration);
+  bool isStatic() const { return _softbody.isStatic(); }
+  void setStatic(bool isStatic) { _softbody.setStatic(isStatic); }
+
+  void applyForce(const glm::vec3 &force) { _softbody.applyForce(force); }
+  void accelerate(const glm::vec3 &acceleration) {
+    _softbody.accelerate(acceleration);
+  }
 
   /**
-   * @brief Calculates the axis-aligned bounding box of the softbody object
+   * @brief The current axis-aligned bounding box of the softbody object
    *
    * @return AABB The axis-aligned bounding box
    */
-  AABB getAABB() const;
+  const AABB &getAABB() const { return _softbody.getAABB(); }
 
   /**
-   * @brief Attempts to grab a face on the softbody that intersects the ray
-   * and modifies the ray t value.
+   * @brief Attempts to grab the closest face on the softbody that intersects
+   * the ray and modifies the ray t value.
    *
    * @param ray The ray to intersect with
    * @param modelMatrix The model matrix of the object
    * @return bool True if a face was grabbed
    */
-  bool grab(Ray &ray, const glm::mat4 &modelMatrix);
+  bool grab(Ray &ray, const glm::mat4 &modelMatrix) {
+    return _softbody.grab(ray, modelMatrix);
+  }
 
-  void updateGrabPoint(const glm::vec3 &grabPoint) { _grabPoint = grabPoint; };
+  void updateGrabPoint(const glm::vec3 &grabPoint) {
+    _softbody.updateGrabPoint(grabPoint);
+  };
 
   /**
    * @brief Releases the grabbed face
    */
-  void release() { _grabbedFaceIdx = -1; };
+  void release() { _softbody.release(); };
+
+  Softbody &getSoftbody() { return _softbody; }
+  const Softbody &getSoftbody() const { return _softbody; }
 
 protected:
   virtual unsigned int indicesCount() const override {
-    return _softbodyMesh.faces.size() * 3;
+    return _softbody.getMesh().faces.size() * 3;
   }
 
-private:
-  SoftbodyMesh _softbodyMesh;
-
-  bool _isStatic = false;
+  virtual bool hasOctahedralNormals() const override { return true; }
 
-  // Grabbing information
-  int _grabbedFaceIdx = -1;
-  glm::vec3 _grabPoint;        // The point where the face was grabbed.
-  float _grabRestDistances[3]; // Rest distances from the initial grabbed
-                               // point to the vertices of the grabbed face.
-  float _grabLengthLambdas[3]; // Lambda values for the distance constraints.
-
-  void moveGrabbed(float deltaTime);
-
-  // Simulation helpers
-  void preSolve(float deltaTime);
-  void solveConstraints(float deltaTime);
-  void handleCollision();
-  void postSolve(float deltaTime);
-
-  // Physics helpers
-  void solveDistanceConstraints(PointMass &p0, PointMass &p1, float restLength,
-                                float &lambdaLength, float alpha);
-  void solveVolumeConstraint(float deltaTime);
-  // void solveBendingConstraints(float deltaTime);
+private:
+  Softbody _softbody;
 
-  // Calculates the angle between two normals accounting for the signs
-  // float calculateAngle(glm::vec3 nL, glm::vec3 nR, glm::vec3 eM,
-  //                      float &arcCosSign);
+  // The per-frame render attributes of the point masses in the GPU vertex
+  // format
+  SoftbodyRenderStates _renderStates;
 
-  // Rendering information update helpers
-  void updateNormals();
+  // Creates the vertex buffers from the current state of the softbody
+  void createBuffers();
 };
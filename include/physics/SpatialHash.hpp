@@ -0,0 +1,67 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "core/AABB.hpp"
+
+/**
+ * @brief A uniform grid of cells hashed into a fixed size table.
+ *
+ * Rebuilt from scratch every frame with a counting sort, so it does not
+ * allocate once its buffers have grown. Boxes that would cover too many cells
+ * are kept in a separate list that every query checks.
+ */
+class SpatialHash {
+public:
+  SpatialHash(float cellSize = 1.0f, unsigned int tableSize = 4096)
+      : _cellSize(cellSize), _tableSize(tableSize){};
+
+  float getCellSize() const { return _cellSize; }
+  void setCellSize(float cellSize) { _cellSize = cellSize; }
+
+  /**
+   * @brief Insert every box, replacing the previous contents.
+   * Ids are the indices into boxes.
+   *
+   * @param boxes The boxes to insert
+   */
+  void build(const std::vector<AABB> &boxes);
+
+  /**
+   * @brief Find every inserted box that overlaps the given box.
+   *
+   * @param box The box to query
+   * @param out Cleared, then filled with the ids of the overlapping boxes
+   */
+  void query(const AABB &box, std::vector<unsigned int> &out);
+
+  /**
+   * @brief Find every pair of inserted boxes that overlap.
+   *
+   * @param out Cleared, then filled with the pairs, first id smaller
+   */
+  void findPairs(std::vector<std::pair<unsigned int, unsigned int>> &out);
+
+private:
+  float _cellSize;
+  unsigned int _tableSize;
+
+  std::vector<AABB> _boxes;
+  // Cell h spans [_cellStart[h], _cellStart[h + 1]) of _cellEntries
+  std::vector<unsigned int> _cellStart;
+  std::vector<unsigned int> _cellEntries;
+  // Boxes covering more cells than the table has
+  std::vector<unsigned int> _largeBoxes;
+
+  // Used to report each box once per query
+  std::vector<unsigned int> _stamps;
+  unsigned int _stamp = 0;
+
+  // Scratch storage of findPairs, kept to avoid reallocating it every frame
+  std::vector<unsigned int> _hits;
+
+  // Returns false if the box covers too many cells to insert
+  bool cellRange(const AABB &box, int (&lo)[3], int (&hi)[3]) const;
+  unsigned int hashCell(int x, int y, int z) const;
+};
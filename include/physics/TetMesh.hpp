@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "physics/SoftbodyMesh.hpp"
+
+struct TetEdge {
+  unsigned int particleIndices[2];
+  float restLength{0.0f};
+  float lambdaLength{0.0f};
+};
+
+struct Tet {
+  unsigned int particleIndices[4];
+  // Signed, six times the volume. Matches the sign of the current volume
+  // as long as the tet is not inverted.
+  float restVolume{0.0f};
+  float lambdaVolume{0.0f};
+};
+
+// Where a point mass of the surface sits inside the tets. Its position is the
+// weighted sum of the four particles of the tet.
+struct TetEmbedding {
+  unsigned int tetIndex;
+  glm::vec4 weights; // Barycentric, sum to 1
+};
+
+/**
+ * @brief A volumetric body made of tetrahedra that a surface mesh is skinned
+ * to.
+ *
+ * The surface is embedded in a regular grid: every cell whose center lies
+ * inside the surface or that holds one of its point masses becomes solid and
+ * is split into 6 tets along its main diagonal. All cells are split the same
+ * way, so neighboring tets share whole faces. The tets are simulated in place
+ * of the surface, each with a volume constraint of its own, and every surface
+ * point mass follows the tet it was embedded in.
+ */
+struct TetMesh {
+  // Cells along the longest side of the surface bounds
+  static constexpr int DEFAULT_RESOLUTION = 10;
+
+  TetMesh() = default;
+  /**
+   * @brief Tetrahedralizes a closed surface
+   *
+   * @param surface The surface to fill, in any space. The tets are built in
+   * the same space.
+   * @param resolution Cells along the longest side of the surface bounds
+   */
+  TetMesh(const SoftbodyMesh &surface, int resolution = DEFAULT_RESOLUTION);
+
+  size_t particleCount() const { return positions.size(); }
+
+  // Stored as a structure of arrays like the point masses of SoftbodyMesh
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> prevPositions;
+  std::vector<glm::vec3> velocities;
+  std::vector<float> invMasses;
+
+  std::vector<TetEdge> edges;
+  std::vector<Tet> tets;
+  // Colorings of the edge and the tet volume constraints
+  ConstraintColoring edgeColoring;
+  ConstraintColoring tetColoring;
+
+  // One per surface point mass
+  std::vector<TetEmbedding> embeddings;
+  // The particles inside the surface. Unlike the ones around the outside
+  // they may collide on their own without the surface hovering above what
+  // it rests on.
+  std::vector<unsigned int> interiorParticles;
+
+  float calculateVolume() const;
+
+  // The position of surface point mass i given the particle positions
+  glm::vec3 embeddedPosition(unsigned int i,
+                             const std::vector<glm::vec3> &positions) const {
+    const TetEmbedding &embedding = embeddings[i];
+    const unsigned int *indices = tets[embedding.tetIndex].particleIndices;
+    return embedding.weights.x * positions[indices[0]] +
+           embedding.weights.y * positions[indices[1]] +
+           embedding.weights.z * positions[indices[2]] +
+           embedding.weights.w * positions[indices[3]];
+  }
+
+  // How hard surface point mass i is to move, the inverse mass a constraint
+  // on it sees
+  float embeddedInvMass(unsigned int i) const;
+
+  /**
+   * @brief Moves the particles around surface point mass i so that it moves
+   * by delta, each in proportion to its weight and inverse mass
+   */
+  void displaceEmbedded(unsigned int i, const glm::vec3 &delta);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "core/AABB.hpp"
+
+struct Ray;
+struct SoftbodyFace;
+
+/**
+ * @brief Bounding volume hierarchy over the faces of a softbody.
+ *
+ * The tree is built once, from the positions the faces have when it is first
+ * needed. Softbodies keep their topology, so afterwards only the boxes are
+ * refit to the current positions, which is linear and does not allocate.
+ * Leaves are tested against the ray a batch of faces at a time.
+ */
+class TriangleBVH {
+public:
+  /**
+   * @brief Builds the tree, splitting at the median centroid of the longest
+   * axis
+   */
+  void build(const std::vector<glm::vec3> &positions,
+             const std::vector<SoftbodyFace> &faces);
+
+  /**
+   * @brief Refits the boxes bottom-up to the positions, the faces have to be
+   * the ones the tree was built from
+   */
+  void refit(const std::vector<glm::vec3> &positions,
+             const std::vector<SoftbodyFace> &faces);
+
+  bool isBuilt() const { return !_nodes.empty(); }
+
+  /**
+   * @brief Finds the closest face hit by the ray, in the space of the
+   * positions. Children are visited nearest first and subtrees further than
+   * the closest hit so far are skipped.
+   *
+   * @param ray The ray, its invDir must be set
+   * @param positions The positions the tree was last built or refit to
+   * @param faces The faces the tree was built from
+   * @param t Set to the t value of the hit
+   * @return int The index of the face hit, -1 if there is none
+   */
+  int raycast(const Ray &ray, const std::vector<glm::vec3> &positions,
+              const std::vector<SoftbodyFace> &faces, float &t) const;
+
+private:
+  // An inner node has count 0 and its children at first and first + 1.
+  // A leaf holds _faceIndices[first, first + count).
+  struct Node {
+    AABB box;
+    unsigned int first;
+    unsigned int count;
+  };
+
+  std::vector<Node> _nodes;
+  std::vector<unsigned int> _faceIndices;
+
+  static constexpr unsigned int MAX_LEAF_SIZE = 4;
+};
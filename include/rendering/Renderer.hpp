@@ -13,7 +13,9 @@ class Renderer {
 public:
   Renderer(const Window &window);
 
-  void render(const Entity &rootNode) const;
+  // Renders the scene between the state before the last update (0) and the
+  // newest state (1)
+  void render(const Entity &rootNode, float interpolation = 1.0f) const;
   void renderDebugQuad() const;
 
   void flipPolygonMode();
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "rendering/SoftbodyVertex.hpp"
+
+class Softbody;
+class Transform;
+
+/**
+ * @brief The two states of a softbody that its vertex buffers interpolate
+ * between, in the GPU vertex format.
+ *
+ * A frame may simulate any number of steps but draws once. The buffers have
+ * to hold the state of the last step and of the step before it, so before
+ * every step that is not the first since the last upload the positions are
+ * kept as the previous state. Does not touch OpenGL.
+ */
+class SoftbodyRenderStates {
+public:
+  /**
+   * @brief Runs a step of the softbody and keeps track of what the buffers
+   * need. Touches no shared state, so different bodies can be simulated in
+   * parallel.
+   */
+  void simulate(Softbody &softbody, float deltaTime, Transform &transform);
+
+  /**
+   * @brief Packs the states the buffers need after the steps simulated since
+   * the last call, recalculating the normals of the softbody
+   *
+   * @return unsigned int 0 if the buffers are up to date, 1 if current() has
+   * to be uploaded, 2 if previous() and then current() have to be
+   */
+  unsigned int gather(Softbody &softbody);
+
+  /**
+   * @brief Packs the softbody as it is into current(), with the normals it
+   * has, to create the buffers from
+   */
+  void reset(const Softbody &softbody);
+
+  const std::vector<SoftbodyVertex> &previous() const { return _previous; }
+  const std::vector<SoftbodyVertex> &current() const { return _current; }
+
+private:
+  std::vector<SoftbodyVertex> _previous;
+  std::vector<SoftbodyVertex> _current;
+
+  // The positions before the last step, valid if that step moved the body
+  // and was not the first since the last upload
+  std::vector<glm::vec3> _previousPositions;
+  bool _previousValid = false;
+
+  bool _moved = false; // The body moved since the last gather
+  unsigned int _stepsSinceUpload = 0;
+  bool _atRest = false; // Both buffered states show the current body
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+struct SoftbodyMesh;
+
+// The part of the GPU vertex format of a softbody that changes every update,
+// gathered from the point mass arrays once per frame. The uvs never change and
+// live in their own static buffer.
+struct SoftbodyVertex {
+  glm::vec3 position{0.0f, 0.0f, 0.0f};
+  // Octahedral-encoded unit normal, two snorm16 components
+  uint32_t normal = 0;
+};
+static_assert(sizeof(SoftbodyVertex) == 16, "SoftbodyVertex must stay packed");
+
+/**
+ * @brief Maps a unit vector onto the [-1, 1] square, inverse of
+ * decodeOctahedral in the vertex shaders
+ */
+glm::vec2 encodeOctahedral(const glm::vec3 &normal);
+glm::vec3 decodeOctahedral(const glm::vec2 &encoded);
+
+/**
+ * @brief Packs the render attributes of every point mass of the mesh.
+ * Does not touch OpenGL.
+ *
+ * @param mesh The mesh to read the positions and normals from
+ * @param out_vertices Room for mesh.pointMassCount() vertices
+ */
+void packSoftbodyVertices(const SoftbodyMesh &mesh,
+                          SoftbodyVertex *out_vertices);
+
+/**
+ * @brief Packs the uvs of the mesh as pairs of half floats, uploaded once
+ *
+ * @param mesh The mesh to read the uvs from
+ * @param out_uvs One packed uv per point mass
+ */
+void packSoftbodyUVs(const SoftbodyMesh &mesh, std::vector<uint32_t> &out_uvs);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/**
+ * @brief A vertex buffer for data that is rewritten every physics step.
+ *
+ * The storage is allocated once and stays mapped. It is split into
+ * REGION_COUNT regions that are written in turn. Draws read the newest region
+ * and the one before it, to interpolate between the last two physics states,
+ * and a fence keeps the CPU from overwriting a region the GPU may still be
+ * reading.
+ */
+class StreamingBuffer {
+public:
+  // Two regions are read by the draws, the rest let the GPU fall a couple of
+  // frames behind even when several steps run per frame
+  static constexpr unsigned int REGION_COUNT = 6;
+
+  StreamingBuffer() = default;
+  ~StreamingBuffer();
+
+  StreamingBuffer(const StreamingBuffer &) = delete;
+  StreamingBuffer &operator=(const StreamingBuffer &) = delete;
+
+  // Allocates and maps the storage for REGION_COUNT regions of regionSize
+  // bytes
+  void create(size_t regionSize);
+
+  /**
+   * @brief Moves on to the next region, waiting for the GPU to finish with it
+   * if needed. The region before the previous one stops being read, every
+   * command issued so far counts as reading it.
+   *
+   * @return void* The mapped memory of the region, regionSize bytes
+   */
+  void *nextRegion();
+
+  GLuint getBuffer() const { return _buffer; }
+  // Byte offset of the region returned by the last nextRegion
+  size_t getOffset() const { return _region * _regionSize; }
+  // Byte offset of the region returned by the nextRegion before that
+  size_t getPreviousOffset() const {
+    return (_region + REGION_COUNT - 1) % REGION_COUNT * _regionSize;
+  }
+
+private:
+  GLuint _buffer = 0;
+  char *_mapped = nullptr;
+  size_t _regionSize = 0;
+  unsigned int _region = 0;
+  GLsync _fences[REGION_COUNT] = {};
+};
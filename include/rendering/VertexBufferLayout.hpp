@@ -16,7 +16,10 @@
 
 #include "physics/SoftbodyMesh.hpp"
 
+#include "rendering/StreamingBuffer.hpp"
+
 struct MeshVertex;
+struct SoftbodyVertex;
 
 class VertexBufferLayout {
 public:
@@ -26,6 +29,8 @@ public:
   GLuint _vbo = 0;
   // Index Buffer Object
   GLuint _ebo = 0;
+  // Per-frame vertex data, only used by softbodies
+  StreamingBuffer _stream;
 
   VertexBufferLayout() = default;
 
@@ -45,18 +50,24 @@ public:
   // texcoords: s,t
   // tangent: t_x,t_y,t_z
   // bitangent b_x,b_y,b_z
+  // previous position and normal: the position and normal again
   void createBufferLayout(std::vector<MeshVertex> &vertices,
                           std::vector<unsigned int> &indices);
 
   // A softbody buffer layout needs the following attributes
   // positions: x,y,z
-  // texcoords: s,t
-  // normals:  x,y,z
-  void createSoftBodyBufferLayout(std::vector<PointMass> &vertices,
-                                  std::vector<SoftbodyFace> &faces);
+  // texcoords: s,t as half floats
+  // normals:  octahedral x,y as snorm16
+  // previous position and normal: the same of the previous physics step
+  // The uvs go into a static buffer, the positions and normals are streamed
+  // through a persistently mapped ring of SoftbodyVertex regions.
+  void createSoftBodyBufferLayout(const std::vector<SoftbodyVertex> &vertices,
+                                  const std::vector<uint32_t> &uvs,
+                                  const std::vector<SoftbodyFace> &faces);
 
-  void updateSoftBodyBufferLayout(std::vector<PointMass> &vertices,
-                                  std::vector<SoftbodyFace> &faces);
+  // Writes the vertices into the next free region and points the VAO at it,
+  // and at the region written before as the previous state
+  void updateSoftBodyBufferLayout(const std::vector<SoftbodyVertex> &vertices);
 };
 
 #endif
@@ -5,22 +5,48 @@
 // graphics pipeline.
 layout(location=0) in vec3 position;
 layout(location=1) in vec2 textures;
-layout(location=2) in vec3 normals;
+layout(location=2) in vec3 normals; // Only x,y if u_OctahedralNormals
+// The same of the previous physics step
+layout(location=5) in vec3 prevPosition;
+layout(location=6) in vec3 prevNormals;
 
 // Uniform variables
 uniform mat4 u_Model;
+uniform mat4 u_PrevModel;
+// How far the frame is from the previous physics step to the newest one
+uniform float u_Interpolation;
 uniform mat4 u_View;
 uniform mat4 u_Projection;
+uniform bool u_OctahedralNormals;
 
 out vec3 fragPos;
 out vec2 texCoord;
 out vec3 vertexNormal;
 
+// Inverse of encodeOctahedral in SoftbodyVertex.cpp
+vec3 decodeOctahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+vec3 decodeNormal(vec3 n)
+{
+  return u_OctahedralNormals ? decodeOctahedral(n.xy) : n;
+}
+
 void main()
 {
-  fragPos = vec3(u_Model * vec4(position, 1.0));
+  vec3 normal = mix(decodeNormal(prevNormals), decodeNormal(normals),
+                    u_Interpolation);
+  vec4 worldPos = mix(u_PrevModel * vec4(prevPosition, 1.0),
+                      u_Model * vec4(position, 1.0), u_Interpolation);
+  fragPos = vec3(worldPos);
   texCoord = textures;
-  vertexNormal = mat3(transpose(inverse(u_Model))) * normals;
+  vertexNormal = mat3(transpose(inverse(u_Model))) * normal;
 
-  gl_Position = u_Projection * u_View * u_Model * vec4(position, 1.0);
+  gl_Position = u_Projection * u_View * worldPos;
 }
@@ -1,11 +1,16 @@
 #version 410 core
 
 layout(location=0) in vec3 position;
+layout(location=5) in vec3 prevPosition;
 
 uniform mat4 u_LightSpaceMatrix;
 uniform mat4 u_Model;
+uniform mat4 u_PrevModel;
+uniform float u_Interpolation;
 
 void main()
 {
-    gl_Position = u_LightSpaceMatrix * u_Model * vec4(position, 1.0);
+    vec4 worldPos = mix(u_PrevModel * vec4(prevPosition, 1.0),
+                        u_Model * vec4(position, 1.0), u_Interpolation);
+    gl_Position = u_LightSpaceMatrix * worldPos;
 }
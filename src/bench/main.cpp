@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core/MeshGenerator.hpp"
+#include "core/ObjLoader.hpp"
+#include "core/Profiler.hpp"
+#include "core/ThreadPool.hpp"
+#include "core/Transform.hpp"
+
+#include "physics/Softbody.hpp"
+
+namespace {
+
+const std::string BUNNY_PATH = "res/objects/bunny/bunny_centered_fixed.obj";
+const std::string BUNNY_REDUCED_PATH =
+    "res/objects/bunny/bunny_centered_reduced_fixed.obj";
+
+// Mesh construction is repeated until it took this long in total
+constexpr double MIN_BUILD_SECONDS = 0.2;
+constexpr int MAX_BUILD_REPEATS = 100;
+
+void printUsage() {
+  std::cout << "Usage: bench [options]\n"
+            << "Kernels are timed in situ, by the profiler scopes of full\n"
+            << "updates, so they include the cache effects of the kernels\n"
+            << "around them.\n"
+            << "  --updates N  Timed updates per mesh and solver\n"
+            << "               (default 120)\n"
+            << "  --warmup N   Untimed updates before those (default 30)\n"
+            << "  --threads N  Number of solver threads, 0 for one per core\n"
+            << "               (default 0)\n"
+            << "  --filter S   Only run the meshes whose name contains S\n"
+            << "  --out F      Write the JSON results to the file F instead\n"
+            << "               of the standard output\n"
+            << "  --verbose    Print each mesh and solver to the standard\n"
+            << "               error as it starts\n";
+}
+
+struct BenchMesh {
+  std::string name;
+  std::function<Mesh()> generate;
+  bool isFile = false; // Timed loading includes the obj parse
+};
+
+std::vector<BenchMesh> benchMeshes() {
+  const auto loadObj = [](const std::string &path) {
+    Mesh mesh;
+    if (!ObjLoader::loadMesh(path, mesh, VertexWeld::POSITION_ONLY)) {
+      throw std::runtime_error("Could not load " + path);
+    }
+    return mesh;
+  };
+  return {
+      {"cube", [] { return MeshGenerator::generateCube(); }},
+      {"icosahedron", [] { return MeshGenerator::generateIcosahedron(); }},
+      {"plane_16", [] { return MeshGenerator::generatePlane(16, 16); }},
+      {"plane_64", [] { return MeshGenerator::generatePlane(64, 64); }},
+      {"plane_128", [] { return MeshGenerator::generatePlane(128, 128); }},
+      {"plane_256", [] { return MeshGenerator::generatePlane(256, 256); }},
+      {"bunny_reduced", [=] { return loadObj(BUNNY_REDUCED_PATH); }, true},
+      {"bunny", [=] { return loadObj(BUNNY_PATH); }, true},
+  };
+}
+
+// A profiler scope reported as a kernel, and how many items it processes per
+// update. Kernels are not run on their own: they are timed in situ while full
+// updates run, so a kernel finds the caches the way the kernels before it
+// left them, as it does in the game.
+struct Kernel {
+  const char *name;
+  const char *scope;
+  const char *item;
+  size_t items;
+};
+
+// Min and average time of running func, in nanoseconds
+void timeRepeated(const std::function<void()> &func, double &min,
+                  double &average) {
+  min = 0.0;
+  double total = 0.0;
+  int repeats = 0;
+  while (repeats < MAX_BUILD_REPEATS &&
+         (repeats == 0 || total < MIN_BUILD_SECONDS * 1e9)) {
+    const auto start = std::chrono::steady_clock::now();
+    func();
+    const auto end = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(end - start)
+                          .count();
+    min = repeats == 0 ? ns : std::min(min, ns);
+    total += ns;
+    repeats++;
+  }
+  average = total / repeats;
+}
+
+std::string number(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.3f", value);
+  return text;
+}
+
+// How a mesh is simulated
+struct BenchSolver {
+  const char *name;
+  SolverType solverType;
+  bool volumetric; // Filled with tets at the default resolution
+};
+
+const BenchSolver BENCH_SOLVERS[] = {
+    {"gauss_seidel", SolverType::GAUSS_SEIDEL, false},
+    {"jacobi", SolverType::JACOBI, false},
+    {"tetrahedral", SolverType::GAUSS_SEIDEL, true},
+};
+
+void runBenchmark(const BenchMesh &benchMesh, const BenchSolver &solver,
+                  int warmup, int updates, std::ostream &json) {
+  double loadMin = 0.0, loadAverage = 0.0;
+  Mesh mesh;
+  timeRepeated([&] { mesh = benchMesh.generate(); }, loadMin, loadAverage);
+  double buildMin = 0.0, buildAverage = 0.0;
+  SoftbodyMesh softbodyMesh;
+  timeRepeated([&] { softbodyMesh = SoftbodyMesh(mesh); }, buildMin,
+               buildAverage);
+
+  Softbody softbody(softbodyMesh);
+  softbody.setSolverType(solver.solverType);
+  softbody.setSleepingEnabled(false);
+  double tetBuildMin = 0.0, tetBuildAverage = 0.0;
+  if (solver.volumetric) {
+    timeRepeated([&] { softbody.setVolumetric(true); }, tetBuildMin,
+                 tetBuildAverage);
+  }
+  const SubstepSettings &settings = softbody.getSubstepSettings();
+  const size_t solves = settings.substeps * settings.iterations;
+
+  // Drop it onto the floor, so collision handling does some work
+  Transform transform;
+  transform.setPosition(0.0f, 2.0f, 0.0f);
+  transform.computeModelMatrix();
+  const float deltaTime = 1.0f / 60.0f;
+
+  Profiler &profiler = Profiler::global();
+  for (int i = 0; i < warmup; i++) {
+    softbody.update(deltaTime, transform);
+    transform.computeModelMatrix();
+  }
+  profiler.clear();
+  profiler.setEnabled(true);
+  for (int i = 0; i < updates; i++) {
+    softbody.update(deltaTime, transform);
+    transform.computeModelMatrix();
+    softbody.updateNormals();
+    profiler.endFrame();
+  }
+  profiler.setEnabled(false);
+
+  const SoftbodyMesh &state = softbody.getMesh();
+  const TetMesh &tetMesh = softbody.getTetMesh();
+  const size_t vertices = state.pointMassCount();
+  const size_t lengths = state.lengthColoring.constraintIndices.size();
+  const size_t spans = state.spanColoring.constraintIndices.size();
+  std::vector<Kernel> kernels;
+  if (solver.volumetric) {
+    // The particles are integrated in place of the surface point masses
+    const size_t particles = tetMesh.particleCount();
+    kernels = {
+        {"update", "Softbody::update", "vertex", vertices},
+        {"pre_solve", "Softbody::preSolve", "particle",
+         particles * settings.substeps},
+        // The interior particles plus the surface points, where the tets
+        // put them
+        {"collision", "Softbody::handleCollision", "particle",
+         (tetMesh.interiorParticles.size() + vertices) * settings.substeps},
+        {"distance", "Softbody::solveTetEdges", "edge",
+         tetMesh.edges.size() * solves},
+        {"volume", "Softbody::solveTetVolumes", "tet",
+         tetMesh.tets.size() * solves},
+        {"post_solve", "Softbody::postSolve", "particle",
+         particles * settings.substeps},
+        {"skinning", "Softbody::skinSurface", "vertex", vertices},
+        {"normals", "Softbody::updateNormals", "vertex", vertices},
+    };
+  } else {
+    kernels = {
+        {"update", "Softbody::update", "vertex", vertices},
+        {"pre_solve", "Softbody::preSolve", "vertex",
+         vertices * settings.substeps},
+        {"collision", "Softbody::handleCollision", "vertex",
+         vertices * settings.substeps},
+        {"distance",
+         solver.solverType == SolverType::JACOBI
+             ? "JacobiSolver::solve"
+             : "Softbody::solveEdgeConstraints",
+         "edge", (lengths + spans) * solves},
+        {"volume", "Softbody::solveVolumeConstraint", "vertex",
+         vertices * solves},
+        {"post_solve", "Softbody::postSolve", "vertex",
+         vertices * settings.substeps},
+        {"normals", "Softbody::updateNormals", "vertex", vertices},
+    };
+  }
+  const std::vector<Profiler::Stats> stats = profiler.getStats();
+
+  json << "    {\"mesh\": \"" << benchMesh.name << "\", \"solver\": \""
+       << solver.name << "\", \"vertices\": " << vertices
+       << ", \"edges\": " << lengths << ", \"spans\": " << spans
+       << ", \"faces\": " << state.faces.size() << ",\n"
+       << "     \"" << (benchMesh.isFile ? "obj_load" : "generate")
+       << "\": {\"min_ns\": " << number(loadMin)
+       << ", \"avg_ns\": " << number(loadAverage) << "},\n"
+       << "     \"mesh_build\": {\"min_ns\": " << number(buildMin)
+       << ", \"avg_ns\": " << number(buildAverage)
+       << ", \"ns_per_vertex\": " << number(buildAverage / vertices)
+       << "},\n";
+  if (solver.volumetric) {
+    json << "     \"particles\": " << tetMesh.particleCount()
+         << ", \"tet_edges\": " << tetMesh.edges.size()
+         << ", \"tets\": " << tetMesh.tets.size()
+         << ", \"tet_colors\": " << tetMesh.tetColoring.colorCount() << ",\n"
+         << "     \"tet_build\": {\"min_ns\": " << number(tetBuildMin)
+         << ", \"avg_ns\": " << number(tetBuildAverage) << "},\n";
+  }
+  json << "     \"kernels\": [";
+  bool first = true;
+  for (const Kernel &kernel : kernels) {
+    for (const Profiler::Stats &scope : stats) {
+      if (scope.isCounter || scope.name != kernel.scope) {
+        continue;
+      }
+      // The profiler reports per-update totals in milliseconds
+      const double average = scope.average * 1e6;
+      json << (first ? "\n" : ",\n") << "       {\"name\": \"" << kernel.name
+           << "\", \"min_ns\": " << number(scope.min * 1e6)
+           << ", \"avg_ns\": " << number(average)
+           << ", \"p99_ns\": " << number(scope.p99 * 1e6) << ", \"ns_per_"
+           << kernel.item << "\": "
+           << number(kernel.items ? average / kernel.items : 0.0) << "}";
+      first = false;
+    }
+  }
+  json << "]}";
+}
+
+} // namespace
+
+int main(int argc, char *args[]) {
+  int updates = 120;
+  int warmup = 30;
+  int threads = 0;
+  std::string filter;
+  std::string outPath;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = args[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage();
+      return 0;
+    }
+    if (arg == "--verbose") {
+      verbose = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      printUsage();
+      return 1;
+    }
+    if (arg == "--updates") {
+      updates = std::stoi(args[++i]);
+    } else if (arg == "--warmup") {
+      warmup = std::stoi(args[++i]);
+    } else if (arg == "--threads") {
+      threads = std::stoi(args[++i]);
+    } else if (arg == "--filter") {
+      filter = args[++i];
+    } else if (arg == "--out") {
+      outPath = args[++i];
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  ThreadPool::global().setThreadCount(threads);
+
+  std::ostringstream json;
+  json << "{\n  \"threads\": " << ThreadPool::global().getThreadCount()
+       << ",\n  \"updates\": " << updates << ",\n  \"substeps\": "
+       << SubstepSettings().substeps
+       << ",\n  \"kernel_timing\": \"in_situ\",\n  \"benchmarks\": [\n";
+  bool first = true;
+  for (const BenchMesh &benchMesh : benchMeshes()) {
+    if (benchMesh.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    for (const BenchSolver &solver : BENCH_SOLVERS) {
+      if (verbose) {
+        std::cerr << benchMesh.name << " " << solver.name << "\n";
+      }
+      if (!first) {
+        json << ",\n";
+      }
+      runBenchmark(benchMesh, solver, warmup, updates, json);
+      first = false;
+    }
+  }
+  json << "\n  ]\n}\n";
+
+  if (outPath.empty()) {
+    std::cout << json.str();
+  } else {
+    std::ofstream file(outPath);
+    file << json.str();
+    if (!file) {
+      std::cerr << "Could not write " << outPath << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -1,12 +1,55 @@
 #include "core/Entity.hpp"
 
 #include "core/Object.hpp"
+#include "core/Profiler.hpp"
+#include "core/ThreadPool.hpp"
+
+#include "physics/CollisionSystem.hpp"
 
 #include "rendering/Shader.hpp"
 
 #include <algorithm>
 
 void Entity::update(float deltaTime) {
+  PROFILE_SCOPE("Entity::update");
+  std::vector<Entity *> entities;
+  updateTransforms(entities);
+  for (auto entity : entities) {
+    entity->_previousModelMatrix = entity->_transform.getModelMatrix();
+  }
+
+  if (_collisionSystem) {
+    std::vector<CollisionBody> bodies;
+    for (auto entity : entities) {
+      bodies.push_back({&entity->_object->getSoftbody(),
+                        entity->_transform.getModelMatrix()});
+    }
+    _collisionSystem->resolve(bodies, deltaTime);
+  }
+
+  // Static objects only take part in collision
+  entities.erase(std::remove_if(entities.begin(), entities.end(),
+                                [](const Entity *entity) {
+                                  return entity->_object->isStatic();
+                                }),
+                 entities.end());
+
+  // Softbodies share no state, so each one is a task of its own. Sleeping
+  // ones only note the step.
+  ThreadPool::global().parallelFor(
+      entities.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          entities[i]->_object->simulate(deltaTime, entities[i]->_transform);
+        }
+      });
+
+  // The softbodies moved their transforms along with them, the new vertices
+  // are drawn with the new model matrices
+  entities.clear();
+  updateTransforms(entities);
+}
+
+void Entity::updateTransforms(std::vector<Entity *> &entities) {
   if (_parent) {
     _transform.computeModelMatrix(_parent->_transform.getModelMatrix());
   } else {
@@ -14,17 +57,20 @@ void Entity::update(float deltaTime) {
   }
 
   if (_object) {
-    _object->update(deltaTime, _transform);
+    entities.push_back(this);
   }
 
   for (auto &child : _children) {
-    child->update(deltaTime);
+    child->updateTransforms(entities);
   }
 }
 
 void Entity::draw(const Shader &shader) const {
   if (_object) {
+    // The buffers are only brought up to date once something draws them
+    _object->updateBuffers();
     shader.setMat4("u_Model", _transform.getModelMatrix());
+    shader.setMat4("u_PrevModel", _previousModelMatrix);
     _object->draw(shader);
   }
 
@@ -42,21 +88,36 @@ void Entity::removeChild(Entity *child) {
   if (it != _children.end()) {
     _children.erase(it);
   }
+
+  // Bodies that rested on the removed ones have to fall
+  Entity *root = this;
+  while (root->_parent) {
+    root = root->_parent;
+  }
+  std::vector<Entity *> entities;
+  root->traverse(entities);
+  for (auto entity : entities) {
+    if (entity->_object) {
+      entity->_object->getSoftbody().wake();
+    }
+  }
 }
 
-void Entity::updateAABB() {
+AABB Entity::getAABB() const {
   if (_object) {
-    _aabb = _object->getAABB();
+    return _object->getAABB();
   }
+  return AABB();
 }
 
 bool Entity::intersects(const Entity &other) const {
-  return _aabb.intersects(other._aabb, other._transform.getModelMatrix(),
-                          _transform.getModelMatrix());
+  return getAABB().intersects(other.getAABB(),
+                              other._transform.getModelMatrix(),
+                              _transform.getModelMatrix());
 }
 
 float Entity::intersects(const Ray &ray) const {
-  return _aabb.intersects(ray, _transform.getModelMatrix());
+  return getAABB().intersects(ray, _transform.getModelMatrix());
 }
 
 void Entity::traverse(std::vector<Entity *> &entities) {
@@ -0,0 +1,57 @@
+#include "core/MappedFile.hpp"
+
+#if defined(LINUX) || defined(MAC)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>
+
+MappedFile::MappedFile(const std::string &filename) {
+#if defined(LINUX) || defined(MAC)
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0) {
+    _size = static_cast<size_t>(info.st_size);
+    _isOpen = true;
+    // Empty files cannot be mapped, but are still valid
+    if (_size > 0) {
+      void *mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        _isOpen = false;
+        _size = 0;
+      } else {
+        _data = static_cast<const char *>(mapped);
+        _isMapped = true;
+      }
+    }
+  }
+  close(fd);
+#else
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return;
+  }
+  _buffer.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(_buffer.data(), _buffer.size())) {
+    return;
+  }
+  _data = _buffer.data();
+  _size = _buffer.size();
+  _isOpen = true;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(LINUX) || defined(MAC)
+  if (_isMapped) {
+    munmap(const_cast<char *>(_data), _size);
+  }
+#endif
+}
@@ -1,146 +1,621 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <map>
 #include <sstream>
 
 #include <glm/glm.hpp>
 
+#include "core/MappedFile.hpp"
 #include "core/ObjLoader.hpp"
+#include "core/ThreadPool.hpp"
 
 #include "rendering/MeshVertex.hpp"
 #include "rendering/Texture.hpp"
 
-bool ObjLoader::loadMesh(const std::string &filename, Mesh &out_mesh,
-                         std::vector<Texture> &out_textures) {
-  std::vector<glm::vec3> temp_vertices;
-  std::vector<glm::vec2> temp_uvs;
-  std::vector<glm::vec3> temp_normals;
+namespace {
+
+// Files smaller than this are parsed on the calling thread
+constexpr size_t PARALLEL_PARSE_MIN_BYTES = 1 << 20;
+
+constexpr unsigned int NO_INDEX = ~0u;
+
+enum ElementType { POSITION, UV, NORMAL, ELEMENT_TYPE_COUNT };
+
+// One corner of a triangle, indices into the v, vt and vn arrays
+struct ObjCorner {
+  unsigned int vertex;
+  unsigned int uv;
+  unsigned int normal;
+};
+
+// The v, vt and vn arrays of the whole file
+struct ObjElements {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+};
+
+// A range of whole lines and what was parsed from it
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+
+  // Number of v, vt and vn lines in the chunk, and in all earlier chunks
+  size_t counts[ELEMENT_TYPE_COUNT] = {0, 0, 0};
+  size_t offsets[ELEMENT_TYPE_COUNT] = {0, 0, 0};
+
+  std::vector<ObjCorner> corners; // Three per triangle
+  std::vector<std::string> materialFiles;
+  bool failed = false;
+};
 
-  if (!ObjLoader::loadObj(filename, temp_vertices, temp_uvs, temp_normals,
-                          out_textures)) {
-    throw std::runtime_error("Failed to load obj file");
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char *skipSpaces(const char *p, const char *end) {
+  while (p < end && isSpace(*p)) {
+    p++;
   }
+  return p;
+}
+
+const char *lineEnd(const char *p, const char *end) {
+  const void *newline = std::memchr(p, '\n', end - p);
+  return newline ? static_cast<const char *>(newline) : end;
+}
+
+const char *nextLine(const char *p, const char *end) {
+  const char *lineEndPtr = lineEnd(p, end);
+  return lineEndPtr < end ? lineEndPtr + 1 : end;
+}
 
-  std::vector<glm::vec3> tangents;
-  std::vector<glm::vec3> bitangents;
+// Returns true if the line starts with the keyword followed by a space
+bool hasKeyword(const char *p, const char *end, const char *keyword) {
+  const size_t length = std::strlen(keyword);
+  return static_cast<size_t>(end - p) > length &&
+         std::memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+}
 
-  if (!ObjLoader::computeTangents(temp_vertices, temp_uvs, temp_normals,
-                                  tangents, bitangents)) {
-    throw std::runtime_error("Failed to compute tangents");
+int elementType(const char *p, const char *end) {
+  if (hasKeyword(p, end, "v")) {
+    return POSITION;
+  }
+  if (hasKeyword(p, end, "vt")) {
+    return UV;
   }
+  if (hasKeyword(p, end, "vn")) {
+    return NORMAL;
+  }
+  return -1;
+}
 
-  if (!ObjLoader::indexVBO(temp_vertices, temp_uvs, temp_normals, tangents,
-                           bitangents, out_mesh._vertices, out_mesh._indices)) {
-    throw std::runtime_error("Failed to create index buffer");
+// Skips the optional + of a number. from_chars does not take one, but the
+// stream based loader did, so files written with it keep loading.
+const char *skipPlus(const char *p, const char *end) {
+  return end - p > 1 && p[0] == '+' && p[1] != '-' ? p + 1 : p;
+}
+
+bool parseFloats(const char *p, const char *end, float *out, int count) {
+  for (int i = 0; i < count; i++) {
+    p = skipPlus(skipSpaces(p, end), end);
+    const auto result = std::from_chars(p, end, out[i]);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    p = result.ptr;
   }
+  return true;
+}
 
+// Parses one index of a face corner and makes it zero-based. Negative indices
+// are relative to the number of elements seen so far.
+bool parseIndex(const char *&p, const char *end, size_t seen,
+                unsigned int &out) {
+  long index = 0;
+  const auto result = std::from_chars(skipPlus(p, end), end, index);
+  if (result.ec != std::errc() || index == 0) {
+    return false;
+  }
+  p = result.ptr;
+  const long resolved = index > 0 ? index - 1 : static_cast<long>(seen) + index;
+  if (resolved < 0) {
+    return false;
+  }
+  out = static_cast<unsigned int>(resolved);
   return true;
 }
 
-bool ObjLoader::loadObj(const std::string &filename,
-                        std::vector<glm::vec3> &out_vertices,
-                        std::vector<glm::vec2> &out_uvs,
-                        std::vector<glm::vec3> &out_normals,
-                        std::vector<Texture> &out_textures) {
-  std::ifstream file(filename);
-  if (!file.is_open()) {
+// The file name of an mtllib line, the rest of the line without the
+// surrounding spaces
+std::string materialName(const char *p, const char *end) {
+  const char *name = skipSpaces(p + 6, end);
+  const char *nameEnd = end;
+  while (nameEnd > name && isSpace(nameEnd[-1])) {
+    nameEnd--;
+  }
+  return std::string(name, nameEnd);
+}
+
+void countObjChunk(ObjChunk &chunk) {
+  for (const char *p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+    const int type = elementType(skipSpaces(p, chunk.end), chunk.end);
+    if (type >= 0) {
+      chunk.counts[type]++;
+    }
+  }
+}
+
+void parseObjChunk(ObjChunk &chunk, ObjElements &elements) {
+  size_t seen[ELEMENT_TYPE_COUNT];
+  std::copy(chunk.offsets, chunk.offsets + ELEMENT_TYPE_COUNT, seen);
+
+  std::vector<ObjCorner> polygon;
+  for (const char *p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+    const char *lineEndPtr = lineEnd(p, chunk.end);
+    p = skipSpaces(p, lineEndPtr);
+
+    bool ok = true;
+    switch (elementType(p, lineEndPtr)) {
+    case POSITION:
+      ok = parseFloats(p + 1, lineEndPtr, &elements.positions[seen[POSITION]].x,
+                       3);
+      seen[POSITION]++;
+      break;
+    case UV:
+      ok = parseFloats(p + 2, lineEndPtr, &elements.uvs[seen[UV]].x, 2);
+      seen[UV]++;
+      break;
+    case NORMAL:
+      ok = parseFloats(p + 2, lineEndPtr, &elements.normals[seen[NORMAL]].x, 3);
+      seen[NORMAL]++;
+      break;
+    default:
+      if (hasKeyword(p, lineEndPtr, "f")) {
+        // Each corner is v, v/vt, v//vn or v/vt/vn
+        polygon.clear();
+        const char *q = skipSpaces(p + 1, lineEndPtr);
+        while (ok && q < lineEndPtr) {
+          ObjCorner corner = {NO_INDEX, NO_INDEX, NO_INDEX};
+          ok = parseIndex(q, lineEndPtr, seen[POSITION], corner.vertex);
+          if (ok && q < lineEndPtr && *q == '/') {
+            q++;
+            if (q < lineEndPtr && *q != '/') {
+              ok = parseIndex(q, lineEndPtr, seen[UV], corner.uv);
+            }
+            if (ok && q < lineEndPtr && *q == '/') {
+              q++;
+              ok = parseIndex(q, lineEndPtr, seen[NORMAL], corner.normal);
+            }
+          }
+          polygon.push_back(corner);
+          q = skipSpaces(q, lineEndPtr);
+        }
+        ok = ok && polygon.size() >= 3;
+
+        // Triangulate as a fan around the first corner
+        for (size_t i = 2; ok && i < polygon.size(); i++) {
+          chunk.corners.push_back(polygon[0]);
+          chunk.corners.push_back(polygon[i - 1]);
+          chunk.corners.push_back(polygon[i]);
+        }
+      } else if (hasKeyword(p, lineEndPtr, "mtllib")) {
+        chunk.materialFiles.push_back(materialName(p, lineEndPtr));
+      }
+      break;
+    }
+
+    if (!ok) {
+      // Exceptions cannot leave a worker thread, loadObj throws instead
+      chunk.failed = true;
+      return;
+    }
+  }
+}
+
+// The parsed contents of a whole obj file
+struct ObjFile {
+  ObjElements elements;
+  std::vector<ObjChunk> chunks;
+
+  glm::vec3 position(const ObjCorner &corner) const {
+    return corner.vertex != NO_INDEX ? elements.positions[corner.vertex]
+                                     : glm::vec3(0, 0, 0);
+  }
+  glm::vec2 uv(const ObjCorner &corner) const {
+    return corner.uv != NO_INDEX ? elements.uvs[corner.uv] : glm::vec2(-1, -1);
+  }
+  glm::vec3 normal(const ObjCorner &corner) const {
+    return corner.normal != NO_INDEX ? elements.normals[corner.normal]
+                                     : glm::vec3(0, 0, 0);
+  }
+};
+
+// Parses the file, in parallel chunks of whole lines if it is large. Throws
+// if it cannot be read, is malformed or a face index is out of range.
+void parseObjFile(const std::string &filename, ObjFile &out_file) {
+  MappedFile file(filename);
+  if (!file.isOpen()) {
     std::string error = "Failed to open file: " + filename;
     throw std::runtime_error(error);
   }
 
-  std::vector<glm::vec3> temp_vertices;
-  std::vector<glm::vec2> temp_uvs;
-  std::vector<glm::vec3> temp_normals;
-  std::vector<ObjFace> temp_faces;
-
   // file format:
   // v x y z
+  // vt u v
   // vn nx ny nz
-  // f v1/vt1/vn1 v2/vt2/vn2 v3/vt3/vn3
-  // vt and vn are optional
+  // f v1/vt1/vn1 v2/vt2/vn2 v3/vt3/vn3 ...
+  // vt and vn are optional, negative indices count back from the latest
+  // element, faces with more than 3 corners are triangulated as a fan
+
+  // Split the file into chunks of whole lines, one per thread for large files
+  const char *const begin = file.data();
+  const char *const end = begin + file.size();
+  ThreadPool &pool = ThreadPool::global();
+  const size_t chunkCount =
+      file.size() < PARALLEL_PARSE_MIN_BYTES ? 1 : pool.getThreadCount();
+  std::vector<ObjChunk> &chunks = out_file.chunks;
+  chunks.assign(chunkCount, ObjChunk());
+  const char *chunkBegin = begin;
+  for (size_t i = 0; i < chunkCount; i++) {
+    const char *chunkEnd =
+        i + 1 == chunkCount ? end : begin + file.size() * (i + 1) / chunkCount;
+    chunkEnd = std::max(chunkEnd, chunkBegin);
+    chunkEnd = chunkEnd < end ? nextLine(chunkEnd, end) : end;
+    chunks[i].begin = chunkBegin;
+    chunks[i].end = chunkEnd;
+    chunkBegin = chunkEnd;
+  }
 
-  std::string line;
-  while (std::getline(file, line)) {
-    std::istringstream stream(line);
-    std::string token;
-    stream >> token;
+  // Count the elements first so every chunk knows where its own start, which
+  // resolves negative indices and lets the chunks fill shared arrays
+  pool.parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      countObjChunk(chunks[i]);
+    }
+  });
+  size_t totals[ELEMENT_TYPE_COUNT] = {0, 0, 0};
+  for (auto &chunk : chunks) {
+    for (int type = 0; type < ELEMENT_TYPE_COUNT; type++) {
+      chunk.offsets[type] = totals[type];
+      totals[type] += chunk.counts[type];
+    }
+  }
 
-    // read for mtllib
-    if (token == "mtllib") {
-      std::string mtlFilename;
-      stream >> mtlFilename;
-      // Get full path
-      mtlFilename =
-          filename.substr(0, filename.find_last_of("/")) + "/" + mtlFilename;
-      loadMtl(mtlFilename, out_textures);
-      continue;
+  ObjElements &elements = out_file.elements;
+  elements.positions.resize(totals[POSITION]);
+  elements.uvs.resize(totals[UV]);
+  elements.normals.resize(totals[NORMAL]);
+  pool.parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      parseObjChunk(chunks[i], elements);
     }
+  });
 
-    switch (token[0]) {
-    case 'v': {
-      if (token.size() == 1) {
-        float x, y, z;
-        stream >> x >> y >> z;
-        temp_vertices.push_back({x, y, z});
-      } else if (token[1] == 't') {
-        float u, v;
-        stream >> u >> v;
-        temp_uvs.push_back({u, v});
-      } else if (token[1] == 'n') {
-        float x, y, z;
-        stream >> x >> y >> z;
-        temp_normals.push_back({x, y, z});
+  for (const auto &chunk : chunks) {
+    if (chunk.failed) {
+      throw std::runtime_error("Malformed obj file: " + filename);
+    }
+    for (const auto &corner : chunk.corners) {
+      if ((corner.vertex != NO_INDEX && corner.vertex >= totals[POSITION]) ||
+          (corner.uv != NO_INDEX && corner.uv >= totals[UV]) ||
+          (corner.normal != NO_INDEX && corner.normal >= totals[NORMAL])) {
+        throw std::runtime_error("Face index out of range in: " + filename);
       }
-      break;
     }
-    case 'f': {
-      // handle optional vt and vn
-      unsigned int vertexIndex[3] = {0, 0, 0}, textureIndex[3] = {0, 0, 0},
-                   normalIndex[3] = {0, 0, 0};
-      for (int i = 0; i < 3; i++) {
-        std::string vertex;
-        stream >> vertex;
-        std::istringstream vertexStream(vertex);
-        vertexStream >> vertexIndex[i];
-        vertexStream.ignore(1);
-        if (vertexStream.peek() != '/') {
-          vertexStream >> textureIndex[i];
+  }
+}
+
+// The tangent and bitangent of a triangle, from its positions and uvs
+void triangleTangents(const glm::vec3 &v0, const glm::vec3 &v1,
+                      const glm::vec3 &v2, const glm::vec2 &uv0,
+                      const glm::vec2 &uv1, const glm::vec2 &uv2,
+                      glm::vec3 &out_tangent, glm::vec3 &out_bitangent) {
+  // Edges of the triangle : position delta
+  glm::vec3 deltaPos1 = v1 - v0;
+  glm::vec3 deltaPos2 = v2 - v0;
+
+  // UV delta
+  glm::vec2 deltaUV1 = uv1 - uv0;
+  glm::vec2 deltaUV2 = uv2 - uv0;
+
+  float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+  out_tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+  out_bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+}
+
+// The size of the buckets attributes are quantized to before welding
+constexpr float WELD_EPSILON = 1e-5f;
+
+// Quantized position, uv and normal of a corner. Comparing integers instead
+// of raw float bytes also treats -0 and 0 as equal.
+struct WeldKey {
+  int64_t values[8];
+
+  bool operator==(const WeldKey &other) const {
+    return std::equal(values, values + 8, other.values);
+  }
+};
+
+WeldKey weldKey(const glm::vec3 &position, const glm::vec2 &uv,
+                const glm::vec3 &normal, VertexWeld weld) {
+  const float attributes[8] = {position.x, position.y, position.z, uv.x,
+                               uv.y,       normal.x,   normal.y,   normal.z};
+  const int attributeCount = weld == VertexWeld::POSITION_ONLY ? 3 : 8;
+
+  WeldKey key = {};
+  for (int i = 0; i < attributeCount; i++) {
+    key.values[i] = std::llround(attributes[i] / WELD_EPSILON);
+  }
+  return key;
+}
+
+uint64_t hashWeldKey(const WeldKey &key) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int64_t value : key.values) {
+    hash = (hash ^ static_cast<uint64_t>(value)) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+// Merges corners whose attributes match into shared vertices, appending to a
+// vertex and an index buffer. Welded corners add up their tangents, and their
+// normals if only the positions have to match.
+//
+// Corners match if their quantized attributes are equal. Positions just
+// either side of a bucket edge quantize differently, so with POSITION_ONLY a
+// corner that finds no vertex in its own bucket also looks in the 26 around
+// it, for a vertex within WELD_EPSILON on every axis. Without that a seam
+// could still tear open.
+class VertexWelder {
+public:
+  VertexWelder(std::vector<MeshVertex> &vertices,
+               std::vector<unsigned int> &indices, size_t cornerCount,
+               VertexWeld weld)
+      : _vertices(vertices), _indices(indices),
+        _firstVertex(vertices.size()), _weld(weld) {
+    _vertices.reserve(_firstVertex + cornerCount);
+    _indices.reserve(_indices.size() + cornerCount);
+
+    // Power of two with at most half of the slots in use, each slot holds an
+    // index into keys. Every corner adds at most one key.
+    size_t tableSize = 1;
+    while (tableSize < cornerCount * 2) {
+      tableSize *= 2;
+    }
+    _slots.assign(tableSize, NO_INDEX);
+    _keys.reserve(cornerCount);
+    _keyVertices.reserve(cornerCount);
+  }
+
+  void add(const glm::vec3 &position, const glm::vec2 &uv,
+           const glm::vec3 &normal, const glm::vec3 &tangent,
+           const glm::vec3 &bitangent) {
+    const WeldKey key = weldKey(position, uv, normal, _weld);
+    const size_t slot = findSlot(key);
+    unsigned int vertex =
+        _slots[slot] != NO_INDEX ? _keyVertices[_slots[slot]] : NO_INDEX;
+    if (vertex == NO_INDEX && _weld == VertexWeld::POSITION_ONLY) {
+      vertex = findNearby(key, position);
+      if (vertex != NO_INDEX) {
+        // Later corners of this bucket find the vertex straight away
+        addKey(slot, key, vertex);
+      }
+    }
+
+    if (vertex == NO_INDEX) {
+      // Not found, add a new vertex
+      addKey(slot, key, static_cast<unsigned int>(_vertices.size()));
+      _indices.push_back(_vertices.size());
+      _vertices.push_back({position, uv, normal, tangent, bitangent});
+      return;
+    }
+
+    // Found, use the existing vertex
+    _indices.push_back(vertex);
+
+    // Update the tangent and bitangent
+    _vertices[vertex].tangent += tangent;
+    _vertices[vertex].bitangent += bitangent;
+    if (_weld == VertexWeld::POSITION_ONLY) {
+      _vertices[vertex].normal += normal;
+    }
+  }
+
+  // Normalizes the summed normals, once all corners are added
+  void finish() {
+    if (_weld != VertexWeld::POSITION_ONLY) {
+      return;
+    }
+    for (size_t i = _firstVertex; i < _vertices.size(); i++) {
+      glm::vec3 &normal = _vertices[i].normal;
+      const float length = glm::length(normal);
+      normal = length > 0 ? normal / length : normal;
+    }
+  }
+
+private:
+  std::vector<MeshVertex> &_vertices;
+  std::vector<unsigned int> &_indices;
+  const size_t _firstVertex;
+  const VertexWeld _weld;
+  std::vector<unsigned int> _slots;
+  std::vector<WeldKey> _keys;
+  // The vertex every key stands for, several keys may share one
+  std::vector<unsigned int> _keyVertices;
+
+  // The slot holding the key, or the empty slot it belongs in
+  size_t findSlot(const WeldKey &key) const {
+    // Fibonacci hashing, then linear probing
+    const size_t mask = _slots.size() - 1;
+    size_t slot = ((hashWeldKey(key) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (_slots[slot] != NO_INDEX && !(_keys[_slots[slot]] == key)) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void addKey(size_t slot, const WeldKey &key, unsigned int vertex) {
+    _slots[slot] = static_cast<unsigned int>(_keys.size());
+    _keys.push_back(key);
+    _keyVertices.push_back(vertex);
+  }
+
+  // A vertex in one of the buckets around the key that is within
+  // WELD_EPSILON of the position on every axis, NO_INDEX if there is none
+  unsigned int findNearby(const WeldKey &key,
+                          const glm::vec3 &position) const {
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+          if (dx == 0 && dy == 0 && dz == 0) {
+            continue;
+          }
+          WeldKey neighbor = key;
+          neighbor.values[0] += dx;
+          neighbor.values[1] += dy;
+          neighbor.values[2] += dz;
+          const unsigned int index = _slots[findSlot(neighbor)];
+          if (index == NO_INDEX) {
+            continue;
+          }
+          const unsigned int vertex = _keyVertices[index];
+          const glm::vec3 offset =
+              glm::abs(_vertices[vertex].position - position);
+          if (std::max({offset.x, offset.y, offset.z}) <= WELD_EPSILON) {
+            return vertex;
+          }
         }
-        vertexStream.ignore(1);
-        vertexStream >> normalIndex[i];
       }
-      temp_faces.push_back(
-          {{vertexIndex[0] - 1, vertexIndex[1] - 1, vertexIndex[2] - 1},
-           {textureIndex[0] - 1, textureIndex[1] - 1, textureIndex[2] - 1},
-           {normalIndex[0] - 1, normalIndex[1] - 1, normalIndex[2] - 1}});
-      break;
     }
-    default:
-      break;
+    return NO_INDEX;
+  }
+};
+
+} // namespace
+
+bool ObjLoader::loadMesh(const std::string &filename, Mesh &out_mesh,
+                         std::vector<Texture> &out_textures) {
+  return loadMeshData(filename, out_mesh, &out_textures,
+                      VertexWeld::ALL_ATTRIBUTES);
+}
+
+bool ObjLoader::loadMesh(const std::string &filename, Mesh &out_mesh,
+                         VertexWeld weld) {
+  return loadMeshData(filename, out_mesh, nullptr, weld);
+}
+
+bool ObjLoader::loadMeshData(const std::string &filename, Mesh &out_mesh,
+                             std::vector<Texture> *out_textures,
+                             VertexWeld weld) {
+  ObjFile obj;
+  parseObjFile(filename, obj);
+
+  // Weld the corners of each triangle straight into the mesh
+  size_t cornerCount = 0;
+  for (const auto &chunk : obj.chunks) {
+    cornerCount += chunk.corners.size();
+  }
+  VertexWelder welder(out_mesh._vertices, out_mesh._indices, cornerCount,
+                      weld);
+  for (const auto &chunk : obj.chunks) {
+    for (size_t i = 0; i < chunk.corners.size(); i += 3) {
+      const ObjCorner *corners = &chunk.corners[i];
+      const glm::vec3 positions[3] = {obj.position(corners[0]),
+                                      obj.position(corners[1]),
+                                      obj.position(corners[2])};
+      const glm::vec2 uvs[3] = {obj.uv(corners[0]), obj.uv(corners[1]),
+                                obj.uv(corners[2])};
+
+      glm::vec3 tangent;
+      glm::vec3 bitangent;
+      triangleTangents(positions[0], positions[1], positions[2], uvs[0],
+                       uvs[1], uvs[2], tangent, bitangent);
+      for (int j = 0; j < 3; j++) {
+        welder.add(positions[j], uvs[j], obj.normal(corners[j]), tangent,
+                   bitangent);
+      }
+    }
+  }
+  welder.finish();
+
+#ifndef HEADLESS
+  if (out_textures) {
+    for (const auto &chunk : obj.chunks) {
+      for (const auto &mtlFilename : chunk.materialFiles) {
+        loadMtl(materialPath(filename, mtlFilename), *out_textures);
+      }
     }
   }
+#endif
+
+  return true;
+}
+
+bool ObjLoader::findMaterialFiles(const std::string &filename,
+                                  std::vector<std::string> &out_files) {
+  MappedFile file(filename);
+  if (!file.isOpen()) {
+    return false;
+  }
 
-  // Create 3 vertices for each face
-  for (const auto &face : temp_faces) {
-    for (int i = 0; i < 3; i++) {
-      unsigned int vertexIndex = face.vertexIndices[i];
-      unsigned int uvIndex = face.uvIndices[i];
-      unsigned int normalIndex = face.normalIndices[i];
-
-      glm::vec3 vertex =
-          vertexIndex != -1 ? temp_vertices[vertexIndex] : glm::vec3(0, 0, 0);
-      glm::vec2 uv = uvIndex != -1 ? temp_uvs[uvIndex] : glm::vec2(-1, -1);
-      glm::vec3 normal =
-          normalIndex != -1 ? temp_normals[normalIndex] : glm::vec3(0, 0, 0);
-      out_vertices.push_back(vertex);
-      out_uvs.push_back(uv);
-      out_normals.push_back(normal);
+  const char *const end = file.data() + file.size();
+  for (const char *p = file.data(); p < end; p = nextLine(p, end)) {
+    const char *lineEndPtr = lineEnd(p, end);
+    p = skipSpaces(p, lineEndPtr);
+    if (hasKeyword(p, lineEndPtr, "mtllib")) {
+      out_files.push_back(
+          materialPath(filename, materialName(p, lineEndPtr)));
     }
   }
 
   return true;
 }
 
+std::string ObjLoader::materialPath(const std::string &filename,
+                                    const std::string &mtlFilename) {
+  return filename.substr(0, filename.find_last_of("/")) + "/" + mtlFilename;
+}
+
+bool ObjLoader::loadObj(const std::string &filename,
+                        std::vector<glm::vec3> &out_vertices,
+                        std::vector<glm::vec2> &out_uvs,
+                        std::vector<glm::vec3> &out_normals,
+                        std::vector<Texture> *out_textures) {
+  ObjFile obj;
+  parseObjFile(filename, obj);
+
+  // Create 3 vertices for each triangle
+  size_t cornerCount = 0;
+  for (const auto &chunk : obj.chunks) {
+    cornerCount += chunk.corners.size();
+  }
+  out_vertices.reserve(out_vertices.size() + cornerCount);
+  out_uvs.reserve(out_uvs.size() + cornerCount);
+  out_normals.reserve(out_normals.size() + cornerCount);
+  for (const auto &chunk : obj.chunks) {
+    for (const auto &corner : chunk.corners) {
+      out_vertices.push_back(obj.position(corner));
+      out_uvs.push_back(obj.uv(corner));
+      out_normals.push_back(obj.normal(corner));
+    }
+  }
+
+#ifndef HEADLESS
+  if (out_textures) {
+    for (const auto &chunk : obj.chunks) {
+      for (const auto &mtlFilename : chunk.materialFiles) {
+        loadMtl(materialPath(filename, mtlFilename), *out_textures);
+      }
+    }
+  }
+#endif
+
+  return true;
+}
+
 bool ObjLoader::computeNormals(const std::vector<glm::vec3> &in_vertices,
                                const std::vector<unsigned int> &in_indices,
                                std::vector<glm::vec3> &out_normals) {
@@ -188,17 +663,9 @@ bool ObjLoader::computeTangents(const std::vector<glm::vec3> &in_vertices,
     const glm::vec2 &uv1 = in_uvs[i + 1];
     const glm::vec2 &uv2 = in_uvs[i + 2];
 
-    // Edges of the triangle : position delta
-    glm::vec3 deltaPos1 = v1 - v0;
-    glm::vec3 deltaPos2 = v2 - v0;
-
-    // UV delta
-    glm::vec2 deltaUV1 = uv1 - uv0;
-    glm::vec2 deltaUV2 = uv2 - uv0;
-
-    float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-    glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
-    glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    triangleTangents(v0, v1, v2, uv0, uv1, uv2, tangent, bitangent);
 
     // Set the same tangent for all three vertices of the triangle.
     // They will be merged later, in indexVBO
@@ -221,33 +688,19 @@ bool ObjLoader::indexVBO(const std::vector<glm::vec3> &in_vertices,
                          const std::vector<glm::vec3> &in_tangents,
                          const std::vector<glm::vec3> &in_bitangents,
                          std::vector<MeshVertex> &out_vertices,
-                         std::vector<unsigned int> &out_indices) {
-  std::map<ObjVertex, unsigned int> vertexToIndex;
-  for (int i = 0; i < in_vertices.size(); i++) {
-    ObjVertex objVert = {in_vertices[i], in_uvs[i], in_normals[i]};
-
-    auto it = vertexToIndex.find(objVert);
-    if (it == vertexToIndex.end()) {
-      // Not found, add a new vertex
-      unsigned int index = out_vertices.size();
-      vertexToIndex[objVert] = index;
-      out_indices.push_back(index);
-      out_vertices.push_back({in_vertices[i], in_uvs[i], in_normals[i],
-                              in_tangents[i], in_bitangents[i]});
-    } else {
-      // Found, use the existing vertex
-      int index = it->second;
-      out_indices.push_back(index);
-
-      // Update the tangent and bitangent
-      out_vertices[index].tangent += in_tangents[i];
-      out_vertices[index].bitangent += in_bitangents[i];
-    }
+                         std::vector<unsigned int> &out_indices,
+                         VertexWeld weld) {
+  VertexWelder welder(out_vertices, out_indices, in_vertices.size(), weld);
+  for (size_t i = 0; i < in_vertices.size(); i++) {
+    welder.add(in_vertices[i], in_uvs[i], in_normals[i], in_tangents[i],
+               in_bitangents[i]);
   }
+  welder.finish();
 
   return true;
 }
 
+#ifndef HEADLESS
 bool ObjLoader::loadMtl(const std::string &filename,
                         std::vector<Texture> &out_textures) {
   std::ifstream file(filename);
@@ -280,3 +733,4 @@ bool ObjLoader::loadMtl(const std::string &filename,
 
   return true;
 }
+#endif
@@ -13,6 +13,7 @@ void Object::draw(const Shader &shader) const {
 
   // Draw
   shader.setVec3("u_VertexColor", _color);
+  shader.setBool("u_OctahedralNormals", hasOctahedralNormals());
   glDrawElements(GL_TRIANGLES, indicesCount(), GL_UNSIGNED_INT, 0);
 
   // Unbind
@@ -0,0 +1,203 @@
+#include "core/Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+// Events per thread kept for the trace, later ones only count in the stats
+constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+// The buffer of the current thread, and the profiler it belongs to
+thread_local const Profiler *bufferOwner = nullptr;
+thread_local void *buffer = nullptr;
+
+Profiler::Stats summarize(const std::string &name, bool isCounter,
+                          std::vector<double> values) {
+  Profiler::Stats stats;
+  stats.name = name;
+  stats.isCounter = isCounter;
+  stats.frames = values.size();
+  if (values.empty()) {
+    return stats;
+  }
+
+  std::sort(values.begin(), values.end());
+  double sum = 0.0;
+  for (double value : values) {
+    sum += value;
+  }
+  stats.min = values.front();
+  stats.average = sum / values.size();
+  const size_t p99Index =
+      (size_t)std::ceil(0.99 * values.size()) - 1;
+  stats.p99 = values[std::min(p99Index, values.size() - 1)];
+  return stats;
+}
+
+void writeEscaped(std::ostream &stream, const char *text) {
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') {
+      stream << '\\';
+    }
+    stream << *text;
+  }
+}
+
+} // namespace
+
+Profiler &Profiler::global() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::ThreadBuffer &Profiler::threadBuffer() {
+  if (bufferOwner != this) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto &threadBuffer =
+        _threadBuffers.emplace_back(std::make_unique<ThreadBuffer>());
+    threadBuffer->threadId = _threadBuffers.size() - 1;
+    bufferOwner = this;
+    buffer = threadBuffer.get();
+  }
+  return *static_cast<ThreadBuffer *>(buffer);
+}
+
+void Profiler::record(const char *name, int64_t start, int64_t end) {
+  threadBuffer().scopes.push_back({name, start, end});
+}
+
+void Profiler::count(const char *name, double value) {
+  if (!isEnabled()) {
+    return;
+  }
+  threadBuffer().counters.push_back({name, now(), value});
+}
+
+void Profiler::endFrame() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // Sum by name pointer first, there are only a handful of distinct names
+  std::unordered_map<const char *, double> scopeTotals;
+  std::unordered_map<const char *, double> counterTotals;
+  for (auto &threadBuffer : _threadBuffers) {
+    for (const auto &scope : threadBuffer->scopes) {
+      scopeTotals[scope.name] += (scope.end - scope.start) * 1e-6;
+    }
+    for (const auto &counter : threadBuffer->counters) {
+      counterTotals[counter.name] += counter.value;
+    }
+
+    const size_t scopeRoom =
+        MAX_TRACE_EVENTS -
+        std::min(MAX_TRACE_EVENTS, threadBuffer->traceScopes.size());
+    threadBuffer->traceScopes.insert(
+        threadBuffer->traceScopes.end(), threadBuffer->scopes.begin(),
+        threadBuffer->scopes.begin() +
+            std::min(scopeRoom, threadBuffer->scopes.size()));
+    const size_t counterRoom =
+        MAX_TRACE_EVENTS -
+        std::min(MAX_TRACE_EVENTS, threadBuffer->traceCounters.size());
+    threadBuffer->traceCounters.insert(
+        threadBuffer->traceCounters.end(), threadBuffer->counters.begin(),
+        threadBuffer->counters.begin() +
+            std::min(counterRoom, threadBuffer->counters.size()));
+
+    threadBuffer->scopes.clear();
+    threadBuffer->counters.clear();
+  }
+
+  // The same name may come from literals at different addresses
+  std::map<std::string, double> scopeFrame;
+  for (const auto &[name, total] : scopeTotals) {
+    scopeFrame[name] += total;
+  }
+  for (const auto &[name, total] : scopeFrame) {
+    _scopeFrames[name].push_back(total);
+  }
+  std::map<std::string, double> counterFrame;
+  for (const auto &[name, total] : counterTotals) {
+    counterFrame[name] += total;
+  }
+  for (const auto &[name, total] : counterFrame) {
+    _counterFrames[name].push_back(total);
+  }
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto &threadBuffer : _threadBuffers) {
+    threadBuffer->scopes.clear();
+    threadBuffer->counters.clear();
+    threadBuffer->traceScopes.clear();
+    threadBuffer->traceCounters.clear();
+  }
+  _scopeFrames.clear();
+  _counterFrames.clear();
+}
+
+std::vector<Profiler::Stats> Profiler::getStats() const {
+  std::vector<Stats> stats;
+  for (const auto &[name, values] : _scopeFrames) {
+    stats.push_back(summarize(name, false, values));
+  }
+  for (const auto &[name, values] : _counterFrames) {
+    stats.push_back(summarize(name, true, values));
+  }
+  return stats;
+}
+
+void Profiler::printStats(std::ostream &stream) const {
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-36s %8s %12s %12s %12s\n", "scope",
+                "frames", "min", "avg", "p99");
+  stream << line;
+  for (const auto &stats : getStats()) {
+    // Scopes are in milliseconds, counters are plain values
+    const char *format = stats.isCounter ? "%-36s %8zu %12.0f %12.1f %12.0f\n"
+                                         : "%-36s %8zu %10.3fms %10.3fms "
+                                           "%10.3fms\n";
+    std::snprintf(line, sizeof(line), format, stats.name.c_str(), stats.frames,
+                  stats.min, stats.average, stats.p99);
+    stream << line;
+  }
+}
+
+bool Profiler::writeChromeTrace(const std::string &filename) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::ofstream file(filename);
+  if (!file) {
+    return false;
+  }
+
+  // Timestamps are in microseconds
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  char number[64];
+  for (const auto &threadBuffer : _threadBuffers) {
+    for (const auto &scope : threadBuffer->traceScopes) {
+      file << (first ? "" : ",\n") << "{\"name\":\"";
+      writeEscaped(file, scope.name);
+      std::snprintf(number, sizeof(number), "\"ts\":%.3f,\"dur\":%.3f",
+                    scope.start * 1e-3, (scope.end - scope.start) * 1e-3);
+      file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << threadBuffer->threadId
+           << "," << number << "}";
+      first = false;
+    }
+    for (const auto &counter : threadBuffer->traceCounters) {
+      file << (first ? "" : ",\n") << "{\"name\":\"";
+      writeEscaped(file, counter.name);
+      std::snprintf(number, sizeof(number), "\"ts\":%.3f",
+                    counter.time * 1e-3);
+      file << "\",\"ph\":\"C\",\"pid\":0,\"tid\":" << threadBuffer->threadId
+           << "," << number << ",\"args\":{\"value\":" << counter.value
+           << "}}";
+      first = false;
+    }
+  }
+  file << "\n]}\n";
+  return (bool)file;
+}
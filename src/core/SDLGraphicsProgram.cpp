@@ -2,6 +2,7 @@
 
 #include "core/Error.hpp"
 #include "core/MeshGenerator.hpp"
+#include "core/Profiler.hpp"
 #include "core/Ray.hpp"
 
 #include "physics/SoftbodyObject.hpp"
@@ -13,6 +14,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include <cmath>
 #include <iostream>
 
 using MeshType = MeshGenerator::MeshType;
@@ -22,6 +24,7 @@ Entity *currentEntity;
 SDLGraphicsProgram::SDLGraphicsProgram(Window *window, Renderer *renderer)
     : _window(window), _renderer(renderer) {
   _grabber.setCamera(&_renderer->getCamera());
+  _rootNode.setCollisionSystem(&_collisionSystem);
 };
 
 void SDLGraphicsProgram::input(float deltaTime) {
@@ -143,19 +146,22 @@ void SDLGraphicsProgram::input(float deltaTime) {
 
   // Spawn objects
   if (state[SDL_SCANCODE_1] || state[SDL_SCANCODE_2] || state[SDL_SCANCODE_3] ||
-      state[SDL_SCANCODE_4]) {
+      state[SDL_SCANCODE_4] || state[SDL_SCANCODE_5]) {
     SDL_Delay(150);
     MeshType type;
     if (state[SDL_SCANCODE_1]) {
       type = MeshType::CUBE;
     } else if (state[SDL_SCANCODE_2]) {
       type = MeshType::ICOSAHEDRON;
-    } else if (state[SDL_SCANCODE_3]) {
+    } else if (state[SDL_SCANCODE_3] || state[SDL_SCANCODE_5]) {
       type = MeshType::BUNNY_REDUCED;
     } else {
       type = MeshType::BUNNY;
     }
     currentEntity = addObject(type);
+    if (state[SDL_SCANCODE_5]) {
+      currentEntity->getObject()->getSoftbody().setVolumetric(true);
+    }
   }
 
   // Toggle polygon mode
@@ -170,6 +176,22 @@ void SDLGraphicsProgram::input(float deltaTime) {
     _debug = !_debug;
   }
 
+  // Toggle profiling, the results are written once it is turned off
+  if (state[SDL_SCANCODE_P]) {
+    SDL_Delay(200);
+    Profiler &profiler = Profiler::global();
+    if (!profiler.isEnabled()) {
+      profiler.clear();
+      profiler.setEnabled(true);
+    } else {
+      profiler.setEnabled(false);
+      profiler.printStats(std::cout);
+      if (profiler.writeChromeTrace(PROFILE_PATH)) {
+        std::cout << "Trace written to " << PROFILE_PATH << "\n";
+      }
+    }
+  }
+
   _lastTime = SDL_GetTicks();
 }
 
@@ -177,8 +199,8 @@ void SDLGraphicsProgram::update(float deltaTime) {
   _rootNode.update(deltaTime);
 }
 
-void SDLGraphicsProgram::render() const {
-  _renderer->render(_rootNode);
+void SDLGraphicsProgram::render(float interpolation) const {
+  _renderer->render(_rootNode, interpolation);
   if (_debug) {
     _renderer->renderDebugQuad();
   }
@@ -194,15 +216,27 @@ void SDLGraphicsProgram::run() {
 
   while (!_quit) {
     Uint32 currentTime = SDL_GetTicks();
-    Uint32 delta = std::max((unsigned int)1, currentTime - _lastTime);
+    Uint32 delta = currentTime - _lastTime;
     _lastTime = currentTime;
 
     glCheckError("run", 126);
 
     float deltaTime = delta / 1000.0f;
     input(deltaTime);
-    update(deltaTime);
-    render();
+
+    // Step the physics at the fixed rate, catching up on the frame time
+    _accumulator += deltaTime;
+    int steps = 0;
+    while (_accumulator >= _fixedDeltaTime && steps < MAX_STEPS_PER_FRAME) {
+      update(_fixedDeltaTime);
+      _accumulator -= _fixedDeltaTime;
+      steps++;
+    }
+    if (steps == MAX_STEPS_PER_FRAME) {
+      _accumulator = std::fmod(_accumulator, _fixedDeltaTime);
+    }
+
+    render(_accumulator / _fixedDeltaTime);
 
     glCheckError("run", 132);
 
@@ -213,6 +247,7 @@ void SDLGraphicsProgram::run() {
     // std::cout << "delta: " << delta << "ms\n";
 
     _window->swapBuffers();
+    Profiler::global().endFrame();
   }
 }
 
@@ -0,0 +1,180 @@
+#include "core/ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Shared between the caller of parallelFor and the threads that help it.
+// Helpers may still hold on to it after the caller returned, so it only goes
+// back to the free list once the last of them released it.
+struct ThreadPool::Job {
+  RangeFunction func = nullptr;
+  const void *context = nullptr;
+  size_t count = 0;
+  size_t chunkSize = 0;
+  size_t chunkCount = 0;
+  std::atomic<size_t> nextChunk{0};
+  std::atomic<size_t> finishedChunks{0};
+  // Threads that refer to the job, guarded by the mutex of the pool
+  unsigned int references = 0;
+
+  // Claims and runs chunks until none are left
+  void run() {
+    size_t chunk;
+    while ((chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) <
+           chunkCount) {
+      const size_t begin = chunk * chunkSize;
+      const size_t end = std::min(begin + chunkSize, count);
+      func(context, begin, end);
+      finishedChunks.fetch_add(1, std::memory_order_release);
+    }
+  }
+};
+
+ThreadPool::ThreadPool(unsigned int threadCount) { start(threadCount); }
+
+ThreadPool::~ThreadPool() { stop(); }
+
+ThreadPool &ThreadPool::global() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::setThreadCount(unsigned int threadCount) {
+  stop();
+  start(threadCount);
+}
+
+void ThreadPool::start(unsigned int threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  _stopping = false;
+  // The calling thread is the first thread
+  for (unsigned int i = 1; i < threadCount; i++) {
+    _workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+void ThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _condition.notify_all();
+
+  for (auto &worker : _workers) {
+    worker.join();
+  }
+  _workers.clear();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition.wait(lock,
+                      [this] { return _stopping || !_openJobs.empty(); });
+      if (_stopping && _openJobs.empty()) {
+        return;
+      }
+    }
+    helpOpenJob();
+  }
+}
+
+bool ThreadPool::helpOpenJob() {
+  Job *job;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_openJobs.empty()) {
+      return false;
+    }
+    job = _openJobs.back();
+    job->references++;
+  }
+
+  job->run();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  closeJob(job);
+  releaseJob(job);
+  return true;
+}
+
+void ThreadPool::closeJob(Job *job) {
+  const auto open = std::find(_openJobs.begin(), _openJobs.end(), job);
+  if (open != _openJobs.end()) {
+    _openJobs.erase(open);
+  }
+}
+
+void ThreadPool::releaseJob(Job *job) {
+  if (--job->references == 0) {
+    _freeJobs.push_back(job);
+  }
+}
+
+void ThreadPool::runParallelFor(size_t count, size_t grainSize,
+                                RangeFunction func, const void *context) {
+  if (count == 0) {
+    return;
+  }
+
+  grainSize = std::max<size_t>(grainSize, 1);
+  if (_workers.empty() || count <= grainSize) {
+    func(context, 0, count);
+    return;
+  }
+
+  // Aim for a few chunks per thread so uneven chunks balance out
+  const size_t threadCount = getThreadCount();
+  const size_t chunkSize =
+      std::max(grainSize, (count + threadCount * 4 - 1) / (threadCount * 4));
+  const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+  Job *job;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_freeJobs.empty()) {
+      // Only grows until the deepest nesting has been seen
+      _jobs.push_back(std::make_unique<Job>());
+      _freeJobs.push_back(_jobs.back().get());
+      _openJobs.reserve(_jobs.size());
+    }
+    job = _freeJobs.back();
+    _freeJobs.pop_back();
+
+    job->func = func;
+    job->context = context;
+    job->count = count;
+    job->chunkSize = chunkSize;
+    job->chunkCount = chunkCount;
+    job->nextChunk.store(0, std::memory_order_relaxed);
+    job->finishedChunks.store(0, std::memory_order_relaxed);
+    job->references = 1;
+    _openJobs.push_back(job);
+  }
+  if (chunkCount == 2) {
+    _condition.notify_one();
+  } else {
+    _condition.notify_all();
+  }
+
+  job->run();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    closeJob(job);
+  }
+
+  // Help with other open jobs until every chunk is done
+  while (job->finishedChunks.load(std::memory_order_acquire) < chunkCount) {
+    if (!helpOpenJob()) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  releaseJob(job);
+}
@@ -29,7 +29,7 @@ void Transform::computeModelMatrix(const glm::mat4 &parentModelMatrix) {
 
 glm::mat4 Transform::getModelMatrix() const { return _modelMatrix; }
 
-GLfloat *Transform::getMatrixPtr() { return &_modelMatrix[0][0]; }
+float *Transform::getMatrixPtr() { return &_modelMatrix[0][0]; }
 
 glm::vec3 Transform::getPosition() const { return _position; }
 
@@ -0,0 +1,258 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "core/Profiler.hpp"
+#include "core/ThreadPool.hpp"
+
+#include "physics/PhysicsWorld.hpp"
+#include "physics/Scene.hpp"
+
+namespace {
+
+void printUsage() {
+  std::cout << "Usage: headless [options]\n"
+            << "  --steps N   Number of fixed steps to run (default 600)\n"
+            << "  --dt S      Fixed time step in seconds (default 1/60)\n"
+            << "  --mesh M    cube, icosahedron, bunny, bunny_reduced or a path\n"
+            << "              to an obj file (default cube)\n"
+            << "  --count N   Number of bodies to spawn (default 1)\n"
+            << "  --threads N Number of solver threads, 0 for one per core\n"
+            << "              (default 0)\n"
+            << "  --solver S  gauss_seidel or jacobi (default gauss_seidel)\n"
+            << "  --substeps N  Substeps per step, or adaptive (default 10)\n"
+            << "  --iterations N  Solver iterations per substep (default 1)\n"
+            << "  --sleep B   Let resting bodies sleep, 0 or 1 (default 1)\n"
+            << "  --tetrahedral N  Fill the bodies with tets, N cells along\n"
+            << "              their longest side (default 0, surface only)\n"
+            << "  --profile F Print per-step timings and write a Chrome trace\n"
+            << "              to the file F\n"
+            << "  --scene F   Replay the scene file F instead of spawning\n"
+            << "              --count bodies, for its own number of steps\n"
+            << "              unless --steps is given\n"
+            << "  --golden F  Compare the final positions to the snapshot F\n"
+            << "  --write-golden F  Save the final positions as snapshot F\n"
+            << "  --tolerance D  Largest distance a point mass may be off the\n"
+            << "              golden snapshot (default 1e-4)\n";
+}
+
+// FNV-1a hash over the raw bits of every position, used to compare runs
+uint64_t checksum(const PhysicsWorld &world) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const auto &body : world.getBodies()) {
+    for (const auto &position : body->softbody.getMesh().positions) {
+      unsigned char bytes[sizeof(glm::vec3)];
+      std::memcpy(bytes, &position, sizeof(glm::vec3));
+      for (unsigned char byte : bytes) {
+        hash = (hash ^ byte) * 1099511628211ull;
+      }
+    }
+  }
+  return hash;
+}
+
+} // namespace
+
+int main(int argc, char *args[]) {
+  int steps = 600;
+  float deltaTime = 1.0f / 60.0f;
+  std::string mesh = "cube";
+  int count = 1;
+  int threads = 0;
+  SolverType solverType = SolverType::GAUSS_SEIDEL;
+  SubstepSettings substepSettings;
+  bool sleeping = true;
+  int tetResolution = 0;
+  std::string profilePath;
+  std::string scenePath;
+  std::string goldenPath;
+  std::string writeGoldenPath;
+  float tolerance = 1e-4f;
+  bool stepsGiven = false;
+  bool deltaTimeGiven = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = args[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage();
+      return 0;
+    }
+    if (i + 1 >= argc) {
+      printUsage();
+      return 1;
+    }
+    if (arg == "--steps") {
+      steps = std::stoi(args[++i]);
+      stepsGiven = true;
+    } else if (arg == "--dt") {
+      deltaTime = std::stof(args[++i]);
+      deltaTimeGiven = true;
+    } else if (arg == "--mesh") {
+      mesh = args[++i];
+    } else if (arg == "--count") {
+      count = std::stoi(args[++i]);
+    } else if (arg == "--threads") {
+      threads = std::stoi(args[++i]);
+    } else if (arg == "--solver") {
+      const std::string solver = args[++i];
+      if (solver == "jacobi") {
+        solverType = SolverType::JACOBI;
+      } else if (solver != "gauss_seidel") {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--substeps") {
+      const std::string substeps = args[++i];
+      if (substeps == "adaptive") {
+        substepSettings.adaptive = true;
+      } else {
+        substepSettings.substeps = std::stoi(substeps);
+      }
+    } else if (arg == "--iterations") {
+      substepSettings.iterations = std::stoi(args[++i]);
+    } else if (arg == "--sleep") {
+      sleeping = std::stoi(args[++i]) != 0;
+    } else if (arg == "--tetrahedral") {
+      tetResolution = std::stoi(args[++i]);
+    } else if (arg == "--profile") {
+      profilePath = args[++i];
+    } else if (arg == "--scene") {
+      scenePath = args[++i];
+    } else if (arg == "--golden") {
+      goldenPath = args[++i];
+    } else if (arg == "--write-golden") {
+      writeGoldenPath = args[++i];
+    } else if (arg == "--tolerance") {
+      tolerance = std::stof(args[++i]);
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  ThreadPool::global().setThreadCount(threads);
+  PhysicsWorld world(deltaTime);
+
+  Scene scene;
+  if (!scenePath.empty()) {
+    try {
+      scene = Scene::load(scenePath);
+      if (stepsGiven) {
+        scene.steps = steps;
+      }
+      if (deltaTimeGiven) {
+        scene.deltaTime = deltaTime;
+      }
+      scene.start(world);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    steps = scene.steps;
+    deltaTime = scene.deltaTime;
+  } else {
+    // Lay the bodies out on a grid inside the play space
+    for (int i = 0; i < count; i++) {
+      PhysicsBody *body = Scene::spawn(world, mesh);
+      body->softbody.setSolverType(solverType);
+      body->softbody.setSubstepSettings(substepSettings);
+      body->softbody.setSleepingEnabled(sleeping);
+      if (tetResolution > 0) {
+        body->softbody.setVolumetric(true, tetResolution);
+      }
+      body->transform.setPosition(-7.5f + (i % 7) * 2.5f,
+                                  3.0f + (i / 49) * 2.5f,
+                                  -7.5f + ((i / 7) % 7) * 2.5f);
+    }
+  }
+
+  // Every step is a frame of the profiler
+  Profiler &profiler = Profiler::global();
+  profiler.setEnabled(!profilePath.empty());
+  const auto start = std::chrono::steady_clock::now();
+  if (!scenePath.empty()) {
+    try {
+      for (int i = 0; i < steps; i++) {
+        scene.step(world);
+        profiler.endFrame();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  } else if (profiler.isEnabled()) {
+    for (int i = 0; i < steps; i++) {
+      world.step();
+      profiler.endFrame();
+    }
+  } else {
+    world.step(steps);
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double seconds = std::chrono::duration<double>(end - start).count();
+  size_t pointMassCount = 0;
+  size_t tetCount = 0;
+  int sleepingCount = 0;
+  for (const auto &body : world.getBodies()) {
+    pointMassCount += body->softbody.getMesh().pointMassCount();
+    tetCount += body->softbody.getTetMesh().tets.size();
+    sleepingCount += body->softbody.isSleeping() ? 1 : 0;
+  }
+  std::cout << "threads: " << ThreadPool::global().getThreadCount() << "\n"
+            << "bodies: " << world.getBodies().size() << " (" << sleepingCount << " sleeping)\n"
+            << "point masses: " << pointMassCount << "\n"
+            << "tets: " << tetCount << "\n"
+            << "steps: " << steps << " (dt " << deltaTime << "s)\n"
+            << "wall time: " << seconds << "s\n"
+            << "steps/s: " << steps / seconds << "\n"
+            << "checksum: " << std::hex << checksum(world) << std::dec
+            << "\n";
+
+  if (!world.getBodies().empty()) {
+    const glm::vec3 center =
+        world.getBodies().front()->softbody.getMesh().getCenter();
+    std::cout << "first body center: " << center.x << " " << center.y << " "
+              << center.z << "\n"
+              << "first body substeps: "
+              << world.getBodies().front()->softbody.getLastSubstepCount()
+              << "\n";
+  }
+
+  if (!writeGoldenPath.empty()) {
+    if (!WorldSnapshot::capture(world).save(writeGoldenPath)) {
+      std::cerr << "Could not write " << writeGoldenPath << "\n";
+      return 1;
+    }
+    std::cout << "golden written: " << writeGoldenPath << "\n";
+  }
+  if (!goldenPath.empty()) {
+    WorldSnapshot golden;
+    if (!golden.load(goldenPath)) {
+      std::cerr << "Could not read " << goldenPath << "\n";
+      return 1;
+    }
+    const float deviation =
+        WorldSnapshot::capture(world).maxDeviation(golden);
+    const bool matches = deviation <= tolerance;
+    std::cout << "golden max deviation: " << deviation << " (tolerance "
+              << tolerance << ") " << (matches ? "PASS" : "FAIL") << "\n";
+    if (!matches) {
+      return 2;
+    }
+  }
+
+  if (profiler.isEnabled()) {
+    std::cout << "\n";
+    profiler.printStats(std::cout);
+    if (!profiler.writeChromeTrace(profilePath)) {
+      std::cerr << "Could not write " << profilePath << "\n";
+      return 1;
+    }
+    std::cout << "trace: " << profilePath << "\n";
+  }
+
+  return 0;
+}
@@ -20,9 +20,11 @@ int main(int argc, char *args[]) {
             << "  2 - Spawn icosahedron\n"
             << "  3 - Spawn reduced-faces bunny\n"
             << "  4 - Spawn full mesh bunny (quite laggy)\n"
+            << "  5 - Spawn reduced-faces bunny filled with tets\n"
             << "Debug controls:\n"
             << "  Z - Toggle wireframe\n"
             << "  X - Toggle depth map FBO\n"
+            << "  P - Toggle profiling, writes profile.json when stopped\n"
             << "Escape - Quit\n";
 
   Window window(1600, 900);
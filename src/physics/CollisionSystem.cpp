@@ -0,0 +1,294 @@
+#include "physics/CollisionSystem.hpp"
+
+#include "core/Profiler.hpp"
+
+#include "physics/Softbody.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+AABB transformAABB(const AABB &box, const glm::mat4 &modelMatrix) {
+  glm::vec3 min(std::numeric_limits<float>::max());
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  for (int i = 0; i < 8; i++) {
+    const glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                           (i & 2) ? box.max.y : box.min.y,
+                           (i & 4) ? box.max.z : box.min.z);
+    const glm::vec3 world = modelMatrix * glm::vec4(corner, 1.0f);
+    min = glm::min(min, world);
+    max = glm::max(max, world);
+  }
+  return {min, max};
+}
+
+} // namespace
+
+void CollisionSystem::resolve(const std::vector<CollisionBody> &bodies,
+                              float deltaTime) {
+  PROFILE_SCOPE("CollisionSystem::resolve");
+  for (const auto &body : bodies) {
+    body.softbody->clearContacts();
+  }
+  _pairs.clear();
+  if (bodies.size() >= 2) {
+    findPairs(bodies, deltaTime);
+  }
+  updateIslands(bodies);
+
+  _worldPositions.resize(bodies.size());
+  _bodyPositions.assign(bodies.size(), nullptr);
+
+  // Narrow phase, in both directions
+  for (const auto &[a, b] : _pairs) {
+    const Softbody &bodyA = *bodies[a].softbody;
+    const Softbody &bodyB = *bodies[b].softbody;
+    const bool aMoving = !bodyA.isStatic() && !bodyA.isSleeping();
+    const bool bMoving = !bodyB.isStatic() && !bodyB.isSleeping();
+    if (!aMoving && !bMoving) {
+      continue;
+    }
+
+    toWorldSpace(bodies, a);
+    toWorldSpace(bodies, b);
+    collide(bodies, a, b);
+    collide(bodies, b, a);
+  }
+  Profiler::global().count("CollisionSystem::pairs", _pairs.size());
+}
+
+void CollisionSystem::findPairs(const std::vector<CollisionBody> &bodies,
+                                float deltaTime) {
+  // Broad phase, sized so a typical body covers a few cells
+  _bodyBoxes.clear();
+  _margins.clear();
+  float extentSum = 0.0f;
+  unsigned int dynamicCount = 0;
+  for (const auto &body : bodies) {
+    // Grow the box by how far the body can move during the step
+    float maxSpeed = 0.0f;
+    if (!body.softbody->isStatic()) {
+      for (const auto &velocity : body.softbody->getMesh().velocities) {
+        maxSpeed = std::max(maxSpeed, glm::dot(velocity, velocity));
+      }
+    }
+    const float margin = std::sqrt(maxSpeed) * deltaTime + thickness;
+    _margins.push_back(margin);
+
+    AABB box = transformAABB(body.softbody->getAABB(), body.modelMatrix);
+    box.min -= glm::vec3(margin);
+    box.max += glm::vec3(margin);
+    _bodyBoxes.push_back(box);
+    if (!body.softbody->isStatic()) {
+      const glm::vec3 size = box.max - box.min;
+      extentSum += std::max(size.x, std::max(size.y, size.z));
+      dynamicCount++;
+    }
+  }
+  if (dynamicCount == 0) {
+    return;
+  }
+  _broadPhase.setCellSize(extentSum / dynamicCount);
+  _broadPhase.build(_bodyBoxes);
+  _broadPhase.findPairs(_pairs);
+}
+
+void CollisionSystem::updateIslands(const std::vector<CollisionBody> &bodies) {
+  // Union-find over the pairs, static bodies do not join islands, otherwise
+  // everything on the same floor would be one island
+  _islandParents.resize(bodies.size());
+  for (unsigned int i = 0; i < bodies.size(); i++) {
+    _islandParents[i] = i;
+  }
+  for (const auto &[a, b] : _pairs) {
+    if (bodies[a].softbody->isStatic() || bodies[b].softbody->isStatic()) {
+      continue;
+    }
+    _islandParents[findIsland(a)] = findIsland(b);
+  }
+
+  _islandCalm.assign(bodies.size(), true);
+  for (unsigned int i = 0; i < bodies.size(); i++) {
+    const Softbody &body = *bodies[i].softbody;
+    if (!body.isStatic() && !body.isSleeping() && !body.isCalm()) {
+      _islandCalm[findIsland(i)] = false;
+    }
+  }
+  for (unsigned int i = 0; i < bodies.size(); i++) {
+    Softbody &body = *bodies[i].softbody;
+    if (body.isStatic()) {
+      continue;
+    }
+    if (_islandCalm[findIsland(i)]) {
+      body.sleep();
+    } else if (body.isSleeping()) {
+      body.wake();
+    }
+  }
+}
+
+unsigned int CollisionSystem::findIsland(unsigned int index) {
+  while (_islandParents[index] != index) {
+    _islandParents[index] = _islandParents[_islandParents[index]];
+    index = _islandParents[index];
+  }
+  return index;
+}
+
+void CollisionSystem::toWorldSpace(const std::vector<CollisionBody> &bodies,
+                                   unsigned int index) {
+  if (_bodyPositions[index]) {
+    return;
+  }
+
+  // Dynamic bodies are simulated in world space already, only static ones
+  // need their transform applied
+  const auto &positions = bodies[index].softbody->getMesh().positions;
+  const glm::mat4 &modelMatrix = bodies[index].modelMatrix;
+  if (modelMatrix == glm::mat4(1.0f)) {
+    _bodyPositions[index] = &positions;
+    return;
+  }
+  auto &worldPositions = _worldPositions[index];
+  worldPositions.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    worldPositions[i] = modelMatrix * glm::vec4(positions[i], 1.0f);
+  }
+  _bodyPositions[index] = &worldPositions;
+}
+
+void CollisionSystem::collide(const std::vector<CollisionBody> &bodies,
+                              unsigned int a, unsigned int b) {
+  Softbody &bodyA = *bodies[a].softbody;
+  Softbody &bodyB = *bodies[b].softbody;
+  const SoftbodyMesh &meshA = bodyA.getMesh();
+  const SoftbodyMesh &meshB = bodyB.getMesh();
+  const std::vector<glm::vec3> &positionsA = *_bodyPositions[a];
+  const std::vector<glm::vec3> &positionsB = *_bodyPositions[b];
+  const bool aStatic = bodyA.isStatic();
+  const bool bStatic = bodyB.isStatic();
+
+  // Mirroring transforms flip the winding
+  const float orientation =
+      glm::determinant(bodies[b].modelMatrix) < 0.0f ? -meshB.faceOrientation
+                                                     : meshB.faceOrientation;
+  const glm::vec3 sizeB = _bodyBoxes[b].max - _bodyBoxes[b].min;
+  const float maxDepth =
+      maxPenetration * std::min(sizeB.x, std::min(sizeB.y, sizeB.z));
+  // How far apart a point mass and a face may be and still meet this step
+  const float reach = _margins[a] + _margins[b] - thickness;
+
+  // Only the faces of b and point masses of a in the overlap can touch
+  const AABB overlap = {glm::max(_bodyBoxes[a].min, _bodyBoxes[b].min),
+                        glm::min(_bodyBoxes[a].max, _bodyBoxes[b].max)};
+
+  _faceBoxes.clear();
+  _faceIndices.clear();
+  float extentSum = 0.0f;
+  for (unsigned int i = 0; i < meshB.faces.size(); i++) {
+    const auto &indices = meshB.faces[i].pointMassIndices;
+    const glm::vec3 &p0 = positionsB[indices[0]];
+    const glm::vec3 &p1 = positionsB[indices[1]];
+    const glm::vec3 &p2 = positionsB[indices[2]];
+    AABB box = {glm::min(p0, glm::min(p1, p2)),
+                glm::max(p0, glm::max(p1, p2))};
+    box.min -= glm::vec3(std::max(maxDepth, reach) + thickness);
+    box.max += glm::vec3(std::max(maxDepth, reach) + thickness);
+    if (!box.overlaps(overlap)) {
+      continue;
+    }
+    const glm::vec3 size = box.max - box.min;
+    extentSum += std::max(size.x, std::max(size.y, size.z));
+    _faceBoxes.push_back(box);
+    _faceIndices.push_back(i);
+  }
+  if (_faceBoxes.empty()) {
+    return;
+  }
+  _faceHash.setCellSize(extentSum / _faceBoxes.size());
+  _faceHash.build(_faceBoxes);
+
+  for (unsigned int i = 0; i < positionsA.size(); i++) {
+    const glm::vec3 &p = positionsA[i];
+    if (!AABB{p, p}.overlaps(overlap)) {
+      continue;
+    }
+
+    // Find the face closest to the point mass, either just below it or close
+    // enough above it to be reached this step
+    _faceHash.query({p, p}, _hits);
+    int contactFace = -1;
+    float contactDepth = 0.0f;
+    glm::vec3 contactNormal;
+    for (auto hit : _hits) {
+      const auto &indices = meshB.faces[_faceIndices[hit]].pointMassIndices;
+      const glm::vec3 &p0 = positionsB[indices[0]];
+      const glm::vec3 e1 = positionsB[indices[1]] - p0;
+      const glm::vec3 e2 = positionsB[indices[2]] - p0;
+      glm::vec3 normal = glm::cross(e1, e2) * orientation;
+      const float length = glm::length(normal);
+      if (length == 0.0f) {
+        continue;
+      }
+      normal /= length;
+
+      const glm::vec3 d = p - p0;
+      const float depth = glm::dot(d, normal) - thickness;
+      if (depth <= -maxDepth || depth >= reach ||
+          (contactFace >= 0 &&
+           std::fabs(depth) >= std::fabs(contactDepth))) {
+        continue;
+      }
+
+      // The projection onto the face has to be inside it
+      const float d11 = glm::dot(e1, e1);
+      const float d12 = glm::dot(e1, e2);
+      const float d22 = glm::dot(e2, e2);
+      const float dp1 = glm::dot(d, e1);
+      const float dp2 = glm::dot(d, e2);
+      const float denom = d11 * d22 - d12 * d12;
+      const float v = (d22 * dp1 - d12 * dp2) / denom;
+      const float u = (d11 * dp2 - d12 * dp1) / denom;
+      if (v < 0.0f || u < 0.0f || u + v > 1.0f) {
+        continue;
+      }
+
+      contactFace = _faceIndices[hit];
+      contactDepth = depth;
+      contactNormal = normal;
+    }
+    if (contactFace < 0) {
+      continue;
+    }
+
+    // The point mass and the face each give up part of the gap, or take part
+    // of the penetration, weighted by their inverse masses
+    const auto &indices = meshB.faces[contactFace].pointMassIndices;
+    const float wA = aStatic ? 0.0f : meshA.invMasses[i];
+    float wB = 0.0f;
+    if (!bStatic) {
+      for (int k = 0; k < 3; k++) {
+        wB += meshB.invMasses[indices[k]] / 3.0f;
+      }
+    }
+    if (wA + wB == 0.0f) {
+      continue;
+    }
+    const float shareA = contactDepth * wA / (wA + wB);
+    const float shareB = contactDepth - shareA;
+
+    if (wA > 0.0f) {
+      bodyA.addContact(
+          {i, contactNormal, glm::dot(contactNormal, p) - shareA});
+    }
+    if (wB > 0.0f) {
+      for (int k = 0; k < 3; k++) {
+        const glm::vec3 &q = positionsB[indices[k]];
+        bodyB.addContact(
+            {indices[k], -contactNormal, -glm::dot(contactNormal, q) - shareB});
+      }
+    }
+  }
+}
@@ -0,0 +1,160 @@
+#include "physics/JacobiSolver.hpp"
+
+#include "core/Profiler.hpp"
+#include "core/ThreadPool.hpp"
+
+#include "physics/SoftbodyMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Smallest number of constraints or point masses worth handing to a thread
+constexpr size_t JACOBI_GRAIN_SIZE = 1024;
+
+namespace {
+
+// Solves count distance constraints given their deltas p0 - p1, overwriting
+// the deltas with the correction dLambda * dC. Branch-free over contiguous
+// arrays so it vectorizes to 4/8-wide SIMD.
+void solveDistanceBatch(float *__restrict dx, float *__restrict dy,
+                        float *__restrict dz,
+                        const float *__restrict invMasses0,
+                        const float *__restrict invMasses1,
+                        const float *__restrict restLengths,
+                        float *__restrict lambdas, size_t count, float alpha) {
+  for (size_t k = 0; k < count; k++) {
+    const float length =
+        std::sqrt(dx[k] * dx[k] + dy[k] * dy[k] + dz[k] * dz[k]);
+    const float C = length - restLengths[k];
+    float deltaLambda =
+        (-C - alpha * lambdas[k]) / (invMasses0[k] + invMasses1[k] + alpha);
+    // Select rather than branch so the loop stays vectorizable
+    deltaLambda = std::fabs(C) < 0.0001f ? 0.0f : deltaLambda;
+    lambdas[k] += deltaLambda;
+
+    // dC is the normalized delta
+    const float scale = deltaLambda / std::max(length, 1e-12f);
+    dx[k] *= scale;
+    dy[k] *= scale;
+    dz[k] *= scale;
+  }
+}
+
+} // namespace
+
+void DistanceConstraintBatch::add(unsigned int i0, unsigned int i1,
+                                  float restLength,
+                                  const std::vector<float> &invMasses) {
+  indices0.push_back(i0);
+  indices1.push_back(i1);
+  invMasses0.push_back(invMasses[i0]);
+  invMasses1.push_back(invMasses[i1]);
+  restLengths.push_back(restLength);
+  lambdas.push_back(0.0f);
+}
+
+void DistanceConstraintBatch::buildAdjacency(size_t pointMassCount) {
+  pointMassOffsets.assign(pointMassCount + 1, 0);
+  for (size_t k = 0; k < size(); k++) {
+    pointMassOffsets[indices0[k] + 1]++;
+    pointMassOffsets[indices1[k] + 1]++;
+  }
+  for (size_t i = 0; i < pointMassCount; i++) {
+    pointMassOffsets[i + 1] += pointMassOffsets[i];
+  }
+
+  pointMassConstraints.resize(size() * 2);
+  std::vector<unsigned int> cursor(pointMassOffsets.begin(),
+                                   pointMassOffsets.end() - 1);
+  for (size_t k = 0; k < size(); k++) {
+    pointMassConstraints[cursor[indices0[k]]++] = k << 1;
+    pointMassConstraints[cursor[indices1[k]]++] = (k << 1) | 1;
+  }
+}
+
+JacobiSolver::JacobiSolver(const SoftbodyMesh &mesh) {
+  for (const auto &edge : mesh.edges) {
+    _lengths.add(edge.pointMassIndices[0], edge.pointMassIndices[1],
+                 edge.restLength, mesh.invMasses);
+    if (!edge.isBoundary()) {
+      _spans.add(edge.neighborIndices[0], edge.neighborIndices[1],
+                 edge.restSpanLength, mesh.invMasses);
+    }
+  }
+  _lengths.buildAdjacency(mesh.pointMassCount());
+  _spans.buildAdjacency(mesh.pointMassCount());
+
+  _dx.resize(mesh.edges.size());
+  _dy.resize(mesh.edges.size());
+  _dz.resize(mesh.edges.size());
+}
+
+void JacobiSolver::resetLambdas() {
+  std::fill(_lengths.lambdas.begin(), _lengths.lambdas.end(), 0.0f);
+  std::fill(_spans.lambdas.begin(), _spans.lambdas.end(), 0.0f);
+}
+
+void JacobiSolver::solveLengths(SoftbodyMesh &mesh, float alpha) {
+  solve(_lengths, mesh, alpha);
+}
+
+void JacobiSolver::solveSpans(SoftbodyMesh &mesh, float alpha) {
+  solve(_spans, mesh, alpha);
+}
+
+void JacobiSolver::solve(DistanceConstraintBatch &batch, SoftbodyMesh &mesh,
+                         float alpha) {
+  PROFILE_SCOPE("JacobiSolver::solve");
+  glm::vec3 *positions = mesh.positions.data();
+  const float *invMasses = mesh.invMasses.data();
+  ThreadPool &pool = ThreadPool::global();
+
+  // Compute every correction from the same positions. The constraint
+  // correction dLambda * dC is written back over the deltas.
+  pool.parallelFor(batch.size(), JACOBI_GRAIN_SIZE, [&](size_t begin,
+                                                        size_t end) {
+    const unsigned int *indices0 = batch.indices0.data();
+    const unsigned int *indices1 = batch.indices1.data();
+    float *dx = _dx.data();
+    float *dy = _dy.data();
+    float *dz = _dz.data();
+
+    // Gather the constraint deltas into contiguous arrays
+    for (size_t k = begin; k < end; k++) {
+      const glm::vec3 delta = positions[indices0[k]] - positions[indices1[k]];
+      dx[k] = delta.x;
+      dy[k] = delta.y;
+      dz[k] = delta.z;
+    }
+
+    solveDistanceBatch(dx + begin, dy + begin, dz + begin,
+                       batch.invMasses0.data() + begin,
+                       batch.invMasses1.data() + begin,
+                       batch.restLengths.data() + begin,
+                       batch.lambdas.data() + begin, end - begin, alpha);
+  });
+
+  // Each point mass gathers its own corrections, so there are no write
+  // conflicts between threads
+  pool.parallelFor(mesh.pointMassCount(), JACOBI_GRAIN_SIZE, [&](size_t begin,
+                                                                 size_t end) {
+    const unsigned int *offsets = batch.pointMassOffsets.data();
+    const unsigned int *constraints = batch.pointMassConstraints.data();
+    for (size_t i = begin; i < end; i++) {
+      const unsigned int first = offsets[i];
+      const unsigned int last = offsets[i + 1];
+      if (first == last) {
+        continue;
+      }
+
+      glm::vec3 correction(0.0f);
+      for (unsigned int j = first; j < last; j++) {
+        const unsigned int k = constraints[j] >> 1;
+        const float sign = (constraints[j] & 1) ? -1.0f : 1.0f;
+        correction += sign * glm::vec3(_dx[k], _dy[k], _dz[k]);
+      }
+
+      positions[i] += (relaxation * invMasses[i] / (last - first)) * correction;
+    }
+  });
+}
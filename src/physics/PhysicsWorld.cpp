@@ -0,0 +1,51 @@
+#include "physics/PhysicsWorld.hpp"
+
+#include "core/Profiler.hpp"
+#include "core/ThreadPool.hpp"
+
+#include <algorithm>
+
+void PhysicsWorld::removeBody(PhysicsBody *body) {
+  auto it = std::find_if(_bodies.begin(), _bodies.end(),
+                         [body](const std::unique_ptr<PhysicsBody> &other) {
+                           return other.get() == body;
+                         });
+
+  if (it != _bodies.end()) {
+    _bodies.erase(it);
+  }
+
+  // Bodies that rested on the removed one have to fall
+  for (auto &other : _bodies) {
+    other->softbody.wake();
+  }
+}
+
+void PhysicsWorld::step() {
+  PROFILE_SCOPE("PhysicsWorld::step");
+  _collisionBodies.clear();
+  for (auto &body : _bodies) {
+    body->transform.computeModelMatrix();
+    _collisionBodies.push_back(
+        {&body->softbody, body->transform.getModelMatrix()});
+  }
+  _collisionSystem.resolve(_collisionBodies, _fixedDeltaTime);
+
+  // Bodies share no state, so each one is a task of its own. Sleeping
+  // bodies return right away.
+  ThreadPool::global().parallelFor(
+      _bodies.size(), 1, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          PhysicsBody &body = *_bodies[i];
+          body.softbody.update(_fixedDeltaTime, body.transform);
+        }
+      });
+
+  _stepCount++;
+}
+
+void PhysicsWorld::step(int steps) {
+  for (int i = 0; i < steps; i++) {
+    step();
+  }
+}
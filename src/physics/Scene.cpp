@@ -0,0 +1,410 @@
+#include "physics/Scene.hpp"
+
+#include "core/MeshGenerator.hpp"
+#include "core/Ray.hpp"
+
+#include "physics/PhysicsWorld.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Reads the statements of a scene file one token at a time, reporting errors
+// with the line they are on
+class SceneReader {
+public:
+  SceneReader(const std::string &filename) : _filename(filename) {}
+
+  [[noreturn]] void fail(const std::string &message) const {
+    throw std::runtime_error(_filename + ":" + std::to_string(_lineNumber) +
+                             ": " + message);
+  }
+
+  // Moves to the next line with a statement, false at the end of the file
+  bool nextLine(std::istream &stream) {
+    std::string line;
+    while (std::getline(stream, line)) {
+      _lineNumber++;
+      const size_t comment = line.find('#');
+      if (comment != std::string::npos) {
+        line.erase(comment);
+      }
+      _tokens.clear();
+      _tokens.str(line);
+      _tokens.clear();
+      if (_tokens >> std::ws && _tokens.peek() != EOF) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool hasToken() { return (bool)(_tokens >> std::ws) && _tokens.peek() != EOF; }
+
+  std::string token(const char *what) {
+    std::string token;
+    if (!(_tokens >> token)) {
+      fail(std::string("expected ") + what);
+    }
+    return token;
+  }
+
+  float number(const char *what) {
+    const std::string text = token(what);
+    try {
+      size_t end = 0;
+      const float value = std::stof(text, &end);
+      if (end == text.size()) {
+        return value;
+      }
+    } catch (const std::logic_error &) {
+    }
+    fail(std::string("expected ") + what + ", got '" + text + "'");
+  }
+
+  int integer(const char *what) {
+    const float value = number(what);
+    if (value != std::floor(value) || value < 0.0f) {
+      fail(std::string("expected ") + what + " to be a whole number");
+    }
+    return (int)value;
+  }
+
+  glm::vec3 vector(const char *what) {
+    const float x = number(what);
+    const float y = number(what);
+    const float z = number(what);
+    return glm::vec3(x, y, z);
+  }
+
+  // The name and mesh of a body followed by its options
+  SceneBody body() {
+    SceneBody body;
+    body.name = token("a body name");
+    body.mesh = token("a mesh");
+    while (hasToken()) {
+      const std::string option = token("a body option");
+      if (option == "position") {
+        body.position = vector("a position");
+      } else if (option == "rotation") {
+        body.rotation = vector("a rotation");
+      } else if (option == "scale") {
+        body.scale = vector("a scale");
+      } else if (option == "static") {
+        body.isStatic = true;
+      } else if (option == "sleep") {
+        body.isSleepingEnabled = integer("0 or 1") != 0;
+      } else if (option == "solver") {
+        const std::string solver = token("a solver");
+        if (solver == "jacobi") {
+          body.solverType = SolverType::JACOBI;
+        } else if (solver == "gauss_seidel") {
+          body.solverType = SolverType::GAUSS_SEIDEL;
+        } else {
+          fail("unknown solver '" + solver + "'");
+        }
+      } else if (option == "substeps") {
+        const std::string substeps = token("a substep count");
+        if (substeps == "adaptive") {
+          body.substepSettings.adaptive = true;
+        } else {
+          try {
+            body.substepSettings.substeps = std::stoi(substeps);
+          } catch (const std::logic_error &) {
+            fail("expected a substep count, got '" + substeps + "'");
+          }
+        }
+      } else if (option == "iterations") {
+        body.substepSettings.iterations = integer("an iteration count");
+      } else if (option == "tetrahedral") {
+        body.tetResolution = integer("a resolution");
+        if (body.tetResolution == 0) {
+          fail("the resolution must be positive");
+        }
+      } else if (option == "distance_compliance") {
+        body.distanceCompliance = number("a compliance");
+      } else if (option == "volume_compliance") {
+        body.volumeCompliance = number("a compliance");
+      } else if (option == "bending_compliance") {
+        body.bendingCompliance = number("a compliance");
+      } else if (option == "pressure") {
+        body.pressure = number("a pressure");
+      } else {
+        fail("unknown body option '" + option + "'");
+      }
+    }
+    return body;
+  }
+
+private:
+  std::string _filename;
+  int _lineNumber = 0;
+  std::istringstream _tokens;
+};
+
+} // namespace
+
+Scene Scene::load(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file) {
+    throw std::runtime_error("Unable to open scene file: " + filename);
+  }
+
+  Scene scene;
+  SceneReader reader(filename);
+  while (reader.nextLine(file)) {
+    const std::string statement = reader.token("a statement");
+    if (statement == "dt") {
+      scene.deltaTime = reader.number("a time step");
+      if (scene.deltaTime <= 0.0f) {
+        reader.fail("the time step must be positive");
+      }
+    } else if (statement == "steps") {
+      scene.steps = reader.integer("a step count");
+    } else if (statement == "body") {
+      scene.bodies.push_back(reader.body());
+    } else if (statement == "at") {
+      SceneEvent event;
+      event.step = reader.integer("a step");
+      const std::string type = reader.token("an event");
+      if (type == "body") {
+        event.type = SceneEventType::SPAWN;
+        event.body = reader.body();
+      } else {
+        event.body.name = reader.token("a body name");
+        if (type == "grab") {
+          event.type = SceneEventType::GRAB;
+          event.point = reader.vector("a ray origin");
+          event.direction = reader.vector("a ray direction");
+          if (event.direction == glm::vec3(0.0f)) {
+            reader.fail("the ray direction must not be zero");
+          }
+        } else if (type == "drag") {
+          event.type = SceneEventType::DRAG;
+          event.point = reader.vector("a point");
+        } else if (type == "release") {
+          event.type = SceneEventType::RELEASE;
+        } else if (type == "remove") {
+          event.type = SceneEventType::REMOVE;
+        } else {
+          reader.fail("unknown event '" + type + "'");
+        }
+      }
+      // Events of the same step keep the order of the file
+      if (!scene.events.empty() && scene.events.back().step > event.step) {
+        reader.fail("events must be ordered by step");
+      }
+      scene.events.push_back(event);
+    } else {
+      reader.fail("unknown statement '" + statement + "'");
+    }
+
+    if (reader.hasToken()) {
+      reader.fail("unexpected '" + reader.token("") + "'");
+    }
+  }
+  return scene;
+}
+
+PhysicsBody *Scene::spawn(PhysicsWorld &world, const std::string &mesh) {
+  if (mesh == "cube") {
+    return world.addBody(MeshGenerator::generateCube());
+  } else if (mesh == "icosahedron") {
+    return world.addBody(MeshGenerator::generateIcosahedron());
+  } else if (mesh == "tetrahedron") {
+    return world.addBody(MeshGenerator::generateTetrahedron());
+  } else if (mesh == "plane") {
+    return world.addBody(MeshGenerator::generatePlane());
+  } else if (mesh == "bunny") {
+    return world.addBody("res/objects/bunny/bunny_centered_fixed.obj");
+  } else if (mesh == "bunny_reduced") {
+    return world.addBody("res/objects/bunny/bunny_centered_reduced_fixed.obj");
+  }
+  return world.addBody(mesh);
+}
+
+void Scene::start(PhysicsWorld &world) {
+  _bodiesByName.clear();
+  _nextEvent = 0;
+  world.setFixedDeltaTime(deltaTime);
+  for (const SceneBody &body : bodies) {
+    addBody(world, body);
+  }
+}
+
+void Scene::step(PhysicsWorld &world) {
+  const unsigned long stepCount = world.getStepCount();
+  for (; _nextEvent < events.size() && events[_nextEvent].step <= stepCount;
+       _nextEvent++) {
+    const SceneEvent &event = events[_nextEvent];
+    if (event.type == SceneEventType::SPAWN) {
+      addBody(world, event.body);
+      continue;
+    }
+
+    PhysicsBody &body = findBody(event.body.name);
+    switch (event.type) {
+    case SceneEventType::GRAB: {
+      Ray ray;
+      ray.origin = event.point;
+      ray.dir = glm::normalize(event.direction);
+      ray.invDir = 1.0f / ray.dir;
+      body.transform.computeModelMatrix();
+      if (!body.softbody.grab(ray, body.transform.getModelMatrix())) {
+        throw std::runtime_error("The grab at step " +
+                                 std::to_string(event.step) + " misses " +
+                                 event.body.name);
+      }
+      body.softbody.updateGrabPoint(ray.origin + ray.dir * ray.t);
+      break;
+    }
+    case SceneEventType::DRAG:
+      body.softbody.updateGrabPoint(event.point);
+      break;
+    case SceneEventType::RELEASE:
+      body.softbody.release();
+      break;
+    case SceneEventType::REMOVE:
+      world.removeBody(&body);
+      _bodiesByName.erase(event.body.name);
+      break;
+    default:
+      break;
+    }
+  }
+
+  world.step();
+}
+
+void Scene::addBody(PhysicsWorld &world, const SceneBody &body) {
+  if (_bodiesByName.count(body.name)) {
+    throw std::runtime_error("There already is a body named " + body.name);
+  }
+
+  PhysicsBody *added = spawn(world, body.mesh);
+  added->transform.setPosition(body.position)
+      .setRotation(body.rotation)
+      .setScale(body.scale);
+
+  Softbody &softbody = added->softbody;
+  softbody.setStatic(body.isStatic);
+  softbody.setSleepingEnabled(body.isSleepingEnabled);
+  softbody.setSolverType(body.solverType);
+  softbody.setSubstepSettings(body.substepSettings);
+  if (body.tetResolution > 0) {
+    softbody.setVolumetric(true, body.tetResolution);
+  }
+
+  SoftbodyMesh &mesh = softbody.getMesh();
+  if (body.distanceCompliance >= 0.0f) {
+    mesh.distanceCompliance = body.distanceCompliance;
+  }
+  if (body.volumeCompliance >= 0.0f) {
+    mesh.volumeCompliance = body.volumeCompliance;
+  }
+  if (body.bendingCompliance >= 0.0f) {
+    mesh.bendingCompliance = body.bendingCompliance;
+  }
+  if (body.pressure >= 0.0f) {
+    mesh.pressure = body.pressure;
+  }
+
+  _bodiesByName[body.name] = added;
+}
+
+PhysicsBody &Scene::findBody(const std::string &name) const {
+  auto it = _bodiesByName.find(name);
+  if (it == _bodiesByName.end()) {
+    throw std::runtime_error("There is no body named " + name);
+  }
+  return *it->second;
+}
+
+WorldSnapshot WorldSnapshot::capture(const PhysicsWorld &world) {
+  WorldSnapshot snapshot;
+  for (const auto &body : world.getBodies()) {
+    Transform transform = body->transform;
+    transform.computeModelMatrix();
+    const glm::mat4 modelMatrix = transform.getModelMatrix();
+
+    auto &positions = snapshot.bodies.emplace_back();
+    for (const auto &position : body->softbody.getMesh().positions) {
+      positions.push_back(modelMatrix * glm::vec4(position, 1.0f));
+    }
+  }
+  return snapshot;
+}
+
+bool WorldSnapshot::save(const std::string &filename) const {
+  std::ofstream file(filename);
+  if (!file) {
+    return false;
+  }
+
+  // 9 significant digits round-trip a float exactly
+  char line[96];
+  file << "snapshot 1\n" << bodies.size() << "\n";
+  for (const auto &positions : bodies) {
+    file << positions.size() << "\n";
+    for (const auto &position : positions) {
+      std::snprintf(line, sizeof(line), "%.9g %.9g %.9g\n", position.x,
+                    position.y, position.z);
+      file << line;
+    }
+  }
+  return (bool)file;
+}
+
+bool WorldSnapshot::load(const std::string &filename) {
+  std::ifstream file(filename);
+  std::string magic;
+  int version = 0;
+  size_t bodyCount = 0;
+  if (!(file >> magic >> version >> bodyCount) || magic != "snapshot" ||
+      version != 1) {
+    return false;
+  }
+
+  bodies.assign(bodyCount, {});
+  for (auto &positions : bodies) {
+    size_t count = 0;
+    if (!(file >> count)) {
+      return false;
+    }
+    positions.resize(count);
+    for (auto &position : positions) {
+      if (!(file >> position.x >> position.y >> position.z)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+float WorldSnapshot::maxDeviation(const WorldSnapshot &other) const {
+  if (bodies.size() != other.bodies.size()) {
+    return std::numeric_limits<float>::infinity();
+  }
+
+  float deviation = 0.0f;
+  for (size_t i = 0; i < bodies.size(); i++) {
+    if (bodies[i].size() != other.bodies[i].size()) {
+      return std::numeric_limits<float>::infinity();
+    }
+    for (size_t j = 0; j < bodies[i].size(); j++) {
+      const float distance = glm::length(bodies[i][j] - other.bodies[i][j]);
+      // NaN compares false, so check it explicitly
+      if (std::isnan(distance)) {
+        return std::numeric_limits<float>::infinity();
+      }
+      deviation = std::max(deviation, distance);
+    }
+  }
+  return deviation;
+}
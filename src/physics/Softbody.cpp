@@ -0,0 +1,953 @@
+#include "physics/Softbody.hpp"
+
+#include "core/AABB.hpp"
+#include "core/Profiler.hpp"
+#include "core/Ray.hpp"
+#include "core/ThreadPool.hpp"
+#include "core/Transform.hpp"
+
+#include "physics/SoftbodyMeshCache.hpp"
+
+#include <algorithm>
+#include <limits>
+
+glm::vec3 playSpace = glm::vec3(10.0f, 10.0f, 10.0f);
+
+// Smallest number of constraints worth handing to another thread
+constexpr size_t CONSTRAINT_GRAIN_SIZE = 256;
+
+// Largest distance a point mass may travel in one adaptive substep, in mean
+// edge lengths
+constexpr float MAX_SUBSTEP_TRAVEL = 0.5f;
+
+// Point masses per block of the volume constraint sums. Fixed, so the sums
+// do not depend on how many threads there are.
+constexpr size_t VOLUME_BLOCK_SIZE = 1024;
+
+// Smallest number of point masses worth handing to another thread when
+// gathering normals
+constexpr size_t NORMAL_GRAIN_SIZE = 1024;
+
+// Smallest number of surface point masses worth handing to another thread
+// when skinning them to the tets
+constexpr size_t SKIN_GRAIN_SIZE = 1024;
+
+// A body is calm after SLEEP_WINDOW_COUNT windows of SLEEP_WINDOW seconds in
+// which no point mass moved faster than SLEEP_MAX_SPEED on average and the
+// mean kinetic energy per unit mass stayed below SLEEP_MAX_ENERGY. Averaging
+// over a window hides the jitter of point masses resting on something.
+constexpr float SLEEP_WINDOW = 0.5f;
+constexpr int SLEEP_WINDOW_COUNT = 2;
+constexpr float SLEEP_MAX_SPEED = 0.1f;
+constexpr float SLEEP_MAX_ENERGY = 0.001f;
+
+namespace {
+
+// Keeps a point above the ground and inside the play space. A point that
+// left them goes back to where it was and onto the boundary, which also
+// stops it from sliding along it.
+void collideWithPlaySpace(glm::vec3 &position, const glm::vec3 &prevPosition) {
+  // Collide with the ground
+  if (position.y < 0.0f) {
+    position = prevPosition;
+    position.y = 0.0f;
+  }
+
+  // Collide with the play space
+  if (std::fabs(position.x) > playSpace.x) {
+    position = prevPosition;
+    position.x = glm::sign(position.x) * playSpace.x;
+  }
+  if (std::fabs(position.y) > playSpace.y) {
+    position = prevPosition;
+    position.y = glm::sign(position.y) * playSpace.y;
+  }
+  if (std::fabs(position.z) > playSpace.z) {
+    position = prevPosition;
+    position.z = glm::sign(position.z) * playSpace.z;
+  }
+}
+
+} // namespace
+
+Softbody::Softbody(const SoftbodyMesh &softbodyMesh)
+    : _softbodyMesh(softbodyMesh) {
+  initialize();
+}
+
+Softbody::Softbody(const Mesh &mesh) : _softbodyMesh(mesh) { initialize(); }
+
+Softbody::Softbody(const std::string &filename) {
+  std::vector<std::string> materialFiles;
+  SoftbodyMeshCache::loadOrBuild(filename, _softbodyMesh, materialFiles);
+  initialize();
+}
+
+void Softbody::initialize() {
+  calculateAABB();
+
+  float totalLength = 0.0f;
+  for (const auto &edge : _softbodyMesh.edges) {
+    totalLength += edge.restLength;
+  }
+  _meanEdgeLength =
+      _softbodyMesh.edges.empty() ? 0.0f : totalLength / _softbodyMesh.edges.size();
+}
+
+void Softbody::update(float deltaTime, Transform &transform) {
+  if (_isStatic || _isSleeping) {
+    return;
+  }
+  PROFILE_SCOPE("Softbody::update");
+
+  // The point masses live in world space. A transform only appears when the
+  // body is placed or moved from outside, it is applied once and dropped.
+  const glm::mat4 modelMatrix = transform.getModelMatrix();
+  if (modelMatrix != glm::mat4(1.0f)) {
+    for (auto &position : _softbodyMesh.positions) {
+      position = modelMatrix * glm::vec4(position, 1.0f);
+    }
+    for (auto &position : _tetMesh.positions) {
+      position = modelMatrix * glm::vec4(position, 1.0f);
+    }
+    transform.reset();
+    _sleepSnapshot.clear();
+  }
+
+  // Reset lambda values
+  for (auto &edge : _softbodyMesh.edges) {
+    edge.lambdaLength = 0.0f;
+    edge.lambdaSpanLength = 0.0f;
+    // edge.lambdaAngle = 0.0f;
+  }
+  if (_solverType == SolverType::JACOBI) {
+    _jacobiSolver.resetLambdas();
+  }
+  _softbodyMesh.lambdaVolume = 0.0f;
+  for (auto &edge : _tetMesh.edges) {
+    edge.lambdaLength = 0.0f;
+  }
+  for (auto &tet : _tetMesh.tets) {
+    tet.lambdaVolume = 0.0f;
+  }
+  if (_grabbedFaceIdx != -1) {
+    for (int i = 0; i < 3; i++) {
+      _grabLengthLambdas[i] = 0.0f;
+    }
+  }
+
+  // Run the simulation
+  const int substeps = chooseSubstepCount(deltaTime);
+  const int iterations = std::max(_substepSettings.iterations, 1);
+  const float subTimeStep = deltaTime / substeps;
+  for (int i = 0; i < substeps; i++) {
+    preSolve(subTimeStep);
+    handleCollision();
+    for (int j = 0; j < iterations; j++) {
+      solveConstraints(subTimeStep);
+      if (_grabbedFaceIdx != -1) {
+        moveGrabbed(subTimeStep);
+      }
+    }
+    postSolve(subTimeStep, i == substeps - 1);
+  }
+  _lastSubstepCount = substeps;
+  Profiler::global().count("Softbody::substeps", substeps);
+
+  if (isVolumetric()) {
+    skinSurface();
+  }
+
+  updateCalmness(deltaTime);
+
+  _bvhDirty = true;
+}
+
+int Softbody::chooseSubstepCount(float deltaTime) const {
+  if (!_substepSettings.adaptive) {
+    return std::max(_substepSettings.substeps, 1);
+  }
+
+  const int minSubsteps = std::max(_substepSettings.minSubsteps, 1);
+  const int maxSubsteps = std::max(_substepSettings.maxSubsteps, minSubsteps);
+  if (_meanEdgeLength <= 0.0f) {
+    return maxSubsteps;
+  }
+
+  // XPBD stays stable at any compliance, what breaks it is a point mass
+  // moving past its neighbors within one substep. Gravity is added on top
+  // since it acts before the first substep.
+  float maxSpeedSquared = 0.0f;
+  for (const auto &velocity : _softbodyMesh.velocities) {
+    maxSpeedSquared = std::max(maxSpeedSquared, glm::dot(velocity, velocity));
+  }
+  const float maxSpeed = std::sqrt(maxSpeedSquared) + 9.81f * deltaTime;
+  float travel = maxSpeed * deltaTime;
+
+  // The grabbed face is pulled the whole way to the grab point this update
+  if (_grabbedFaceIdx != -1) {
+    const SoftbodyFace &face = _softbodyMesh.faces[_grabbedFaceIdx];
+    for (int i = 0; i < 3; i++) {
+      const glm::vec3 &position =
+          _softbodyMesh.positions[face.pointMassIndices[i]];
+      travel = std::max(travel, glm::length(position - _grabPoint) -
+                                    _grabRestDistances[i]);
+    }
+  }
+
+  const float budget = MAX_SUBSTEP_TRAVEL * _meanEdgeLength;
+  const int substeps = static_cast<int>(std::ceil(travel / budget));
+  return std::min(std::max(substeps, minSubsteps), maxSubsteps);
+}
+
+void Softbody::setSolverType(SolverType solverType) {
+  if (solverType == SolverType::JACOBI && _solverType != solverType) {
+    _jacobiSolver = JacobiSolver(_softbodyMesh);
+  }
+  _solverType = solverType;
+}
+
+void Softbody::setVolumetric(bool volumetric, int resolution) {
+  _tetMesh = volumetric ? TetMesh(_softbodyMesh, resolution) : TetMesh();
+
+  // The particles carry on with the average velocity of the surface
+  glm::vec3 velocity(0.0f);
+  for (const auto &surfaceVelocity : _softbodyMesh.velocities) {
+    velocity += surfaceVelocity;
+  }
+  if (!_softbodyMesh.velocities.empty()) {
+    velocity /= (float)_softbodyMesh.velocities.size();
+  }
+  for (auto &particleVelocity : _tetMesh.velocities) {
+    particleVelocity = velocity;
+  }
+  wake();
+}
+
+void Softbody::updateCalmness(float deltaTime) {
+  if (!_isSleepingEnabled) {
+    return;
+  }
+
+  const auto &positions = _softbodyMesh.positions;
+  if (_sleepSnapshot.size() != positions.size()) {
+    _sleepSnapshot = positions;
+    _sleepWindowTime = 0.0f;
+    return;
+  }
+  _sleepWindowTime += deltaTime;
+  if (_sleepWindowTime < SLEEP_WINDOW) {
+    return;
+  }
+
+  const float invWindowTime = 1.0f / _sleepWindowTime;
+  float maxSpeed2 = 0.0f;
+  float energy = 0.0f;
+  for (size_t i = 0; i < positions.size(); i++) {
+    const glm::vec3 velocity = (positions[i] - _sleepSnapshot[i]) * invWindowTime;
+    const float speed2 = glm::dot(velocity, velocity);
+    maxSpeed2 = std::max(maxSpeed2, speed2);
+    energy += 0.5f * speed2;
+    _sleepSnapshot[i] = positions[i];
+  }
+  energy /= positions.size();
+  _sleepWindowTime = 0.0f;
+
+  const bool calm = maxSpeed2 < SLEEP_MAX_SPEED * SLEEP_MAX_SPEED &&
+                    energy < SLEEP_MAX_ENERGY;
+  _calmWindows = calm ? _calmWindows + 1 : 0;
+}
+
+bool Softbody::isCalm() const {
+  return _isSleepingEnabled && _grabbedFaceIdx == -1 &&
+         _calmWindows >= SLEEP_WINDOW_COUNT;
+}
+
+void Softbody::sleep() {
+  if (_isStatic || _isSleeping) {
+    return;
+  }
+  _isSleeping = true;
+  for (auto &velocity : _softbodyMesh.velocities) {
+    velocity = glm::vec3(0.0f);
+  }
+  for (auto &velocity : _tetMesh.velocities) {
+    velocity = glm::vec3(0.0f);
+  }
+  _contacts.clear();
+}
+
+void Softbody::wake() {
+  _isSleeping = false;
+  _calmWindows = 0;
+  _sleepSnapshot.clear();
+}
+
+void Softbody::setSleepingEnabled(bool isSleepingEnabled) {
+  _isSleepingEnabled = isSleepingEnabled;
+  if (!isSleepingEnabled) {
+    wake();
+  }
+}
+
+void Softbody::applyForce(const glm::vec3 &force) {
+  wake();
+  // Volumetric bodies move through their particles, the surface follows
+  std::vector<glm::vec3> &velocities =
+      isVolumetric() ? _tetMesh.velocities : _softbodyMesh.velocities;
+  const std::vector<float> &invMasses =
+      isVolumetric() ? _tetMesh.invMasses : _softbodyMesh.invMasses;
+  const glm::vec3 forcePerPoint = force / (float)velocities.size();
+  for (size_t i = 0; i < velocities.size(); i++) {
+    velocities[i] += forcePerPoint * invMasses[i];
+  }
+}
+
+void Softbody::accelerate(const glm::vec3 &acceleration) {
+  wake();
+  for (auto &velocity : _softbodyMesh.velocities) {
+    velocity += acceleration;
+  }
+  for (auto &velocity : _tetMesh.velocities) {
+    velocity += acceleration;
+  }
+}
+
+void Softbody::calculateAABB() {
+  if (_softbodyMesh.positions.empty()) {
+    _aabb = AABB();
+    return;
+  }
+
+  glm::vec3 min = _softbodyMesh.positions[0];
+  glm::vec3 max = _softbodyMesh.positions[0];
+  for (const auto &position : _softbodyMesh.positions) {
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+  _aabb = {min, max};
+}
+
+bool Softbody::grab(Ray &ray, const glm::mat4 &modelMatrix) {
+  // The tree is only needed for picking, so it is refit on demand
+  if (!_bvh.isBuilt()) {
+    _bvh.build(_softbodyMesh.positions, _softbodyMesh.faces);
+  } else if (_bvhDirty) {
+    _bvh.refit(_softbodyMesh.positions, _softbodyMesh.faces);
+  }
+  _bvhDirty = false;
+
+  // Cast in local space, the t values are the same in both spaces
+  const glm::mat4 inverseModelMatrix = glm::inverse(modelMatrix);
+  Ray localRay;
+  localRay.origin = inverseModelMatrix * glm::vec4(ray.origin, 1.0f);
+  localRay.dir = inverseModelMatrix * glm::vec4(ray.dir, 0.0f);
+  localRay.invDir = 1.0f / localRay.dir;
+
+  float t;
+  const int faceIdx = _bvh.raycast(localRay, _softbodyMesh.positions,
+                                   _softbodyMesh.faces, t);
+  if (faceIdx < 0) {
+    ray.t = -1.0f;
+    _grabbedFaceIdx = -1;
+    return false;
+  }
+
+  ray.t = t;
+  _grabbedFaceIdx = faceIdx;
+  wake();
+  _grabPoint = ray.origin + ray.dir * t;
+
+  // Calculate the rest distances in world space
+  const SoftbodyFace &face = _softbodyMesh.faces[faceIdx];
+  for (int i = 0; i < 3; i++) {
+    const glm::vec3 vertex =
+        modelMatrix *
+        glm::vec4(_softbodyMesh.positions[face.pointMassIndices[i]], 1.0f);
+    _grabRestDistances[i] = glm::length(vertex - _grabPoint);
+  }
+  return true;
+}
+
+void Softbody::moveGrabbed(float deltaTime) {
+  // Simulate 3 distance constraints
+  const float distanceAlpha =
+      _softbodyMesh.distanceCompliance / std::pow(deltaTime, 2);
+
+  const SoftbodyFace &face = _softbodyMesh.faces[_grabbedFaceIdx];
+  glm::vec3 grabPoint = _grabPoint;
+  for (int i = 0; i < 3; i++) {
+    const unsigned int idx = face.pointMassIndices[i];
+    if (isVolumetric()) {
+      // Pull the point where the tets put the surface, then move the tets
+      // around it along
+      glm::vec3 position = _tetMesh.embeddedPosition(idx, _tetMesh.positions);
+      const glm::vec3 start = position;
+      solveDistanceConstraints(position, _tetMesh.embeddedInvMass(idx),
+                               grabPoint, 0.0f, _grabRestDistances[i],
+                               _grabLengthLambdas[i], distanceAlpha);
+      _tetMesh.displaceEmbedded(idx, position - start);
+      continue;
+    }
+    solveDistanceConstraints(
+        _softbodyMesh.positions[idx], _softbodyMesh.invMasses[idx], grabPoint,
+        0.0f, _grabRestDistances[i], _grabLengthLambdas[i], distanceAlpha);
+  }
+}
+
+void Softbody::preSolve(float deltaTime) {
+  PROFILE_SCOPE("Softbody::preSolve");
+  // Volumetric bodies integrate their particles, the surface follows them
+  const bool volumetric = isVolumetric();
+  std::vector<glm::vec3> &positions =
+      volumetric ? _tetMesh.positions : _softbodyMesh.positions;
+  std::vector<glm::vec3> &prevPositions =
+      volumetric ? _tetMesh.prevPositions : _softbodyMesh.prevPositions;
+  std::vector<glm::vec3> &velocities =
+      volumetric ? _tetMesh.velocities : _softbodyMesh.velocities;
+  const size_t count = positions.size();
+  if (count == 0) {
+    return;
+  }
+
+  // Update velocity
+  const float gravityStep = -9.81f * deltaTime;
+  for (size_t i = 0; i < count; i++) {
+    velocities[i].y += gravityStep;
+  }
+
+  // Save the previous position and integrate, treating the arrays as flat
+  // float streams so the loop vectorizes
+  float *position = &positions.data()->x;
+  float *prevPosition = &prevPositions.data()->x;
+  const float *velocity = &velocities.data()->x;
+  for (size_t i = 0; i < count * 3; i++) {
+    prevPosition[i] = position[i];
+    position[i] += velocity[i] * deltaTime;
+  }
+}
+
+void Softbody::solveConstraints(float deltaTime) {
+  PROFILE_SCOPE("Softbody::solveConstraints");
+  if (isVolumetric()) {
+    solveTetConstraints(deltaTime);
+    return;
+  }
+
+  // Apply distance constraints
+  const float distanceAlpha =
+      _softbodyMesh.distanceCompliance / std::pow(deltaTime, 2);
+  if (_solverType == SolverType::JACOBI) {
+    _jacobiSolver.solveLengths(_softbodyMesh, distanceAlpha);
+  } else {
+    solveEdgeConstraints(_softbodyMesh.lengthColoring, false, distanceAlpha);
+  }
+
+  // Apply volume constraint
+  solveVolumeConstraint(deltaTime);
+
+  // Apply bending constraints
+  // solveBendingConstraints(deltaTime);
+
+  // Angles don't work, create a distance constraint between each face instead
+  const float bendingAlpha =
+      _softbodyMesh.bendingCompliance / std::pow(deltaTime, 2);
+  if (_solverType == SolverType::JACOBI) {
+    _jacobiSolver.solveSpans(_softbodyMesh, bendingAlpha);
+  } else {
+    solveEdgeConstraints(_softbodyMesh.spanColoring, true, bendingAlpha);
+  }
+}
+
+void Softbody::solveEdgeConstraints(const ConstraintColoring &coloring,
+                                    bool span, float alpha) {
+  PROFILE_SCOPE("Softbody::solveEdgeConstraints");
+  std::vector<glm::vec3> &positions = _softbodyMesh.positions;
+  const std::vector<float> &invMasses = _softbodyMesh.invMasses;
+  std::vector<SoftbodyEdge> &edges = _softbodyMesh.edges;
+
+  // Constraints within a color share no point masses, so the result does not
+  // depend on how a color is split between threads
+  for (size_t c = 0; c < coloring.colorCount(); c++) {
+    const unsigned int colorBegin = coloring.colorOffsets[c];
+    const unsigned int colorEnd = coloring.colorOffsets[c + 1];
+    ThreadPool::global().parallelFor(
+        colorEnd - colorBegin, CONSTRAINT_GRAIN_SIZE,
+        [&](size_t begin, size_t end) {
+          for (size_t i = colorBegin + begin; i < colorBegin + end; i++) {
+            SoftbodyEdge &edge = edges[coloring.constraintIndices[i]];
+            if (span) {
+              const unsigned int iL = edge.neighborIndices[0];
+              const unsigned int iR = edge.neighborIndices[1];
+              solveDistanceConstraints(positions[iL], invMasses[iL],
+                                       positions[iR], invMasses[iR],
+                                       edge.restSpanLength,
+                                       edge.lambdaSpanLength, alpha);
+            } else {
+              const unsigned int i0 = edge.pointMassIndices[0];
+              const unsigned int i1 = edge.pointMassIndices[1];
+              solveDistanceConstraints(positions[i0], invMasses[i0],
+                                       positions[i1], invMasses[i1],
+                                       edge.restLength, edge.lambdaLength,
+                                       alpha);
+            }
+          }
+        });
+  }
+}
+
+void Softbody::handleCollision() {
+  PROFILE_SCOPE("Softbody::handleCollision");
+  if (isVolumetric()) {
+    // The particles inside carry the bulk of the body, colliding them keeps
+    // it from sinking in before the surface around has pushed back
+    for (unsigned int i : _tetMesh.interiorParticles) {
+      collideWithPlaySpace(_tetMesh.positions[i], _tetMesh.prevPositions[i]);
+    }
+
+    // Collide the surface where the tets put it, moving the particles around
+    // each point mass that hits something
+    const unsigned int count = _tetMesh.embeddings.size();
+    for (unsigned int i = 0; i < count; i++) {
+      const glm::vec3 position =
+          _tetMesh.embeddedPosition(i, _tetMesh.positions);
+      const glm::vec3 prevPosition =
+          _tetMesh.embeddedPosition(i, _tetMesh.prevPositions);
+      glm::vec3 collided = position;
+      collideWithPlaySpace(collided, prevPosition);
+      if (collided != position) {
+        _tetMesh.displaceEmbedded(i, collided - position);
+      }
+    }
+
+    for (const auto &contact : _contacts) {
+      const unsigned int i = contact.pointMassIndex;
+      const glm::vec3 position =
+          _tetMesh.embeddedPosition(i, _tetMesh.positions);
+      const float distance =
+          glm::dot(contact.normal, position) - contact.offset;
+      if (distance < 0.0f) {
+        _tetMesh.displaceEmbedded(i, -distance * contact.normal);
+      }
+    }
+    return;
+  }
+
+  std::vector<glm::vec3> &positions = _softbodyMesh.positions;
+  const std::vector<glm::vec3> &prevPositions = _softbodyMesh.prevPositions;
+  for (size_t i = 0; i < positions.size(); i++) {
+    collideWithPlaySpace(positions[i], prevPositions[i]);
+  }
+
+  // Collide with other bodies
+  for (const auto &contact : _contacts) {
+    glm::vec3 &position = positions[contact.pointMassIndex];
+    const float distance = glm::dot(contact.normal, position) - contact.offset;
+    if (distance < 0.0f) {
+      position -= distance * contact.normal;
+    }
+  }
+}
+
+void Softbody::postSolve(float deltaTime, bool refitAABB) {
+  PROFILE_SCOPE("Softbody::postSolve");
+  const float oneOverDeltaTime = 1.0f / deltaTime;
+  const bool volumetric = isVolumetric();
+  std::vector<glm::vec3> &positions =
+      volumetric ? _tetMesh.positions : _softbodyMesh.positions;
+  std::vector<glm::vec3> &prevPositions =
+      volumetric ? _tetMesh.prevPositions : _softbodyMesh.prevPositions;
+  std::vector<glm::vec3> &velocities =
+      volumetric ? _tetMesh.velocities : _softbodyMesh.velocities;
+  const size_t count = positions.size();
+  if (count == 0) {
+    return;
+  }
+
+  if (refitAABB && !volumetric) {
+    // The positions are final, so refit the bounds in the same pass
+    glm::vec3 min = positions[0];
+    glm::vec3 max = positions[0];
+    for (size_t i = 0; i < count; i++) {
+      const glm::vec3 position = positions[i];
+      velocities[i] = (position - prevPositions[i]) * oneOverDeltaTime;
+      min = glm::min(min, position);
+      max = glm::max(max, position);
+    }
+    _aabb = {min, max};
+    return;
+  }
+
+  // Update the velocity
+  const float *position = &positions.data()->x;
+  const float *prevPosition = &prevPositions.data()->x;
+  float *velocity = &velocities.data()->x;
+  for (size_t i = 0; i < count * 3; i++) {
+    velocity[i] = (position[i] - prevPosition[i]) * oneOverDeltaTime;
+  }
+}
+
+void Softbody::solveDistanceConstraints(glm::vec3 &p0, float w0, glm::vec3 &p1,
+                                        float w1, float restLength,
+                                        float &lambdaLength, float alpha) {
+  /*
+   * C(p0, p1) = |p0 - p1| - InitialLength
+   * dC(p0, p1)/dp0 = (p0 - p1) / |p0 - p1|
+   * dC(p0, p1)/dp1 = -(p0 - p1) / |p0 - p1|
+   * dL = (-C(p0, p1) - Alpha * lambda) / (m0 + m1 + Alpha)
+   * deltaP = dL * m0 * dC(p0, p1)/dp0
+   */
+  const glm::vec3 delta = p0 - p1;
+  const float C = glm::length(delta) - restLength;
+  if (std::fabs(C) < 0.0001f) {
+    return;
+  }
+
+  const glm::vec3 dC = glm::normalize(delta);
+  const float deltaLambda = (-C - alpha * lambdaLength) / (w0 + w1 + alpha);
+  p0 += deltaLambda * w0 * dC;
+  p1 -= deltaLambda * w1 * dC;
+  lambdaLength += deltaLambda;
+}
+
+void Softbody::solveVolumeConstraint(float deltaTime) {
+  PROFILE_SCOPE("Softbody::solveVolumeConstraint");
+  std::vector<glm::vec3> &positions = _softbodyMesh.positions;
+  const std::vector<float> &invMasses = _softbodyMesh.invMasses;
+  const CornerAdjacency &corners = _softbodyMesh.corners;
+  const size_t count = _softbodyMesh.pointMassCount();
+  const size_t blockCount = (count + VOLUME_BLOCK_SIZE - 1) / VOLUME_BLOCK_SIZE;
+  _volumeGradients.resize(count);
+  _volumeBlockSums.resize(blockCount);
+
+  // Gather dC (gradient of the volume constraint function) per point mass,
+  // summing the volume and the dL denominator on the way. Each face adds
+  // dot(p, dC) once per corner, so the sum over all point masses is 3V.
+  ThreadPool::global().parallelFor(blockCount, 1, [&](size_t first,
+                                                      size_t last) {
+    for (size_t block = first; block < last; block++) {
+      const size_t end = std::min(count, (block + 1) * VOLUME_BLOCK_SIZE);
+      float volume = 0.0f;
+      float denom = 0.0f;
+      for (size_t i = block * VOLUME_BLOCK_SIZE; i < end; i++) {
+        glm::vec3 dC(0.0f);
+        for (unsigned int k = corners.offsets[i]; k < corners.offsets[i + 1];
+             k++) {
+          const auto &edge = corners.oppositeEdges[k];
+          dC += glm::cross(positions[edge.first], positions[edge.second]);
+        }
+        dC /= 6.0f;
+
+        _volumeGradients[i] = dC;
+        volume += glm::dot(positions[i], dC);
+        denom += invMasses[i] * glm::dot(dC, dC);
+      }
+      _volumeBlockSums[block] = glm::vec2(volume, denom);
+    }
+  });
+
+  // Summed in block order, so the result does not depend on the thread count
+  glm::vec2 sums(0.0f);
+  for (const auto &blockSum : _volumeBlockSums) {
+    sums += blockSum;
+  }
+
+  // C = V - V0
+  float C = std::fabs(sums.x / 3.0f) -
+            _softbodyMesh.pressure * _softbodyMesh.restVolume;
+  // Limit constraint to prevent large changes
+  const float maxC = _softbodyMesh.restVolume * 0.1f;
+  C = std::max(std::min(C, maxC), -maxC);
+  if (std::fabs(C) < 0.0001f) {
+    return;
+  }
+
+  const float alpha = _softbodyMesh.volumeCompliance / std::pow(deltaTime, 2);
+
+  // Calculate dL denominator
+  const float denom = alpha + sums.y;
+  if (std::fabs(denom) < 0.0001f) {
+    return;
+  }
+
+  // Calculate delta lambda
+  const float deltaLambda = (-C - alpha * _softbodyMesh.lambdaVolume) / denom;
+  ThreadPool::global().parallelFor(
+      count, VOLUME_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          positions[i] += deltaLambda * invMasses[i] * _volumeGradients[i];
+        }
+      });
+  _softbodyMesh.lambdaVolume += deltaLambda;
+}
+
+void Softbody::solveTetConstraints(float deltaTime) {
+  std::vector<glm::vec3> &positions = _tetMesh.positions;
+  const std::vector<float> &invMasses = _tetMesh.invMasses;
+  ThreadPool &pool = ThreadPool::global();
+
+  // Constraints within a color share no particles, so the result does not
+  // depend on how a color is split between threads
+  {
+    PROFILE_SCOPE("Softbody::solveTetEdges");
+    const float alpha =
+        _softbodyMesh.distanceCompliance / std::pow(deltaTime, 2);
+    const ConstraintColoring &coloring = _tetMesh.edgeColoring;
+    std::vector<TetEdge> &edges = _tetMesh.edges;
+    for (size_t c = 0; c < coloring.colorCount(); c++) {
+      const unsigned int colorBegin = coloring.colorOffsets[c];
+      const unsigned int colorEnd = coloring.colorOffsets[c + 1];
+      pool.parallelFor(
+          colorEnd - colorBegin, CONSTRAINT_GRAIN_SIZE,
+          [&](size_t begin, size_t end) {
+            for (size_t i = colorBegin + begin; i < colorBegin + end; i++) {
+              TetEdge &edge = edges[coloring.constraintIndices[i]];
+              const unsigned int i0 = edge.particleIndices[0];
+              const unsigned int i1 = edge.particleIndices[1];
+              solveDistanceConstraints(positions[i0], invMasses[i0],
+                                       positions[i1], invMasses[i1],
+                                       edge.restLength, edge.lambdaLength,
+                                       alpha);
+            }
+          });
+    }
+  }
+
+  PROFILE_SCOPE("Softbody::solveTetVolumes");
+  const float alpha = _softbodyMesh.volumeCompliance / std::pow(deltaTime, 2);
+  const float pressure = _softbodyMesh.pressure;
+  const ConstraintColoring &coloring = _tetMesh.tetColoring;
+  std::vector<Tet> &tets = _tetMesh.tets;
+  for (size_t c = 0; c < coloring.colorCount(); c++) {
+    const unsigned int colorBegin = coloring.colorOffsets[c];
+    const unsigned int colorEnd = coloring.colorOffsets[c + 1];
+    pool.parallelFor(
+        colorEnd - colorBegin, CONSTRAINT_GRAIN_SIZE,
+        [&](size_t begin, size_t end) {
+          for (size_t i = colorBegin + begin; i < colorBegin + end; i++) {
+            Tet &tet = tets[coloring.constraintIndices[i]];
+            const unsigned int *indices = tet.particleIndices;
+            const glm::vec3 p0 = positions[indices[0]];
+            const glm::vec3 e1 = positions[indices[1]] - p0;
+            const glm::vec3 e2 = positions[indices[2]] - p0;
+            const glm::vec3 e3 = positions[indices[3]] - p0;
+
+            /*
+             * C = 6V - 6V0, with 6V = dot(e1 x e2, e3)
+             * dC/dp1 = e2 x e3, dC/dp2 = e3 x e1, dC/dp3 = e1 x e2
+             * dC/dp0 = -(dC/dp1 + dC/dp2 + dC/dp3)
+             */
+            glm::vec3 dC[4];
+            dC[1] = glm::cross(e2, e3);
+            dC[2] = glm::cross(e3, e1);
+            dC[3] = glm::cross(e1, e2);
+            dC[0] = -(dC[1] + dC[2] + dC[3]);
+
+            const float C = glm::dot(dC[3], e3) - pressure * tet.restVolume;
+            float denom = alpha;
+            for (int j = 0; j < 4; j++) {
+              denom += invMasses[indices[j]] * glm::dot(dC[j], dC[j]);
+            }
+            if (denom == 0.0f) {
+              continue;
+            }
+
+            const float deltaLambda = (-C - alpha * tet.lambdaVolume) / denom;
+            for (int j = 0; j < 4; j++) {
+              positions[indices[j]] +=
+                  deltaLambda * invMasses[indices[j]] * dC[j];
+            }
+            tet.lambdaVolume += deltaLambda;
+          }
+        });
+  }
+}
+
+void Softbody::skinSurface() {
+  PROFILE_SCOPE("Softbody::skinSurface");
+  // Positions and velocities are both linear in the particles, so the
+  // surface moves exactly as the tets around it
+  glm::vec3 *positions = _softbodyMesh.positions.data();
+  glm::vec3 *velocities = _softbodyMesh.velocities.data();
+  const size_t count = _tetMesh.embeddings.size();
+  if (count == 0) {
+    return;
+  }
+
+  // The bounds are refit on the way, per block and then over the blocks in
+  // order
+  const size_t blockCount = (count + SKIN_GRAIN_SIZE - 1) / SKIN_GRAIN_SIZE;
+  _skinBlockBounds.resize(blockCount);
+  ThreadPool::global().parallelFor(blockCount, 1, [&](size_t first,
+                                                      size_t last) {
+    for (size_t block = first; block < last; block++) {
+      const size_t end = std::min(count, (block + 1) * SKIN_GRAIN_SIZE);
+      AABB bounds;
+      bounds.min = glm::vec3(std::numeric_limits<float>::max());
+      bounds.max = glm::vec3(std::numeric_limits<float>::lowest());
+      for (size_t i = block * SKIN_GRAIN_SIZE; i < end; i++) {
+        const glm::vec3 position =
+            _tetMesh.embeddedPosition(i, _tetMesh.positions);
+        positions[i] = position;
+        velocities[i] = _tetMesh.embeddedPosition(i, _tetMesh.velocities);
+        bounds.min = glm::min(bounds.min, position);
+        bounds.max = glm::max(bounds.max, position);
+      }
+      _skinBlockBounds[block] = bounds;
+    }
+  });
+
+  _aabb = _skinBlockBounds[0];
+  for (const auto &bounds : _skinBlockBounds) {
+    _aabb.min = glm::min(_aabb.min, bounds.min);
+    _aabb.max = glm::max(_aabb.max, bounds.max);
+  }
+}
+
+// void Softbody::solveBendingConstraints(float deltaTime) {
+//   float alpha = _softbodyMesh.bendingCompliance / std::pow(deltaTime, 2);
+//   for (auto &edge : _softbodyMesh.edges) {
+//     // First get the 4 point masses
+//     const SoftbodyFace &face0 = _softbodyMesh.faces[edge.faceIndices[0]];
+//     const SoftbodyFace &face1 = _softbodyMesh.faces[edge.faceIndices[1]];
+//     unsigned int i0 = edge.pointMassIndices[0];
+//     unsigned int i1 = edge.pointMassIndices[1];
+//     unsigned int i2 = 0;
+//     for (unsigned int i = 0; i < 3; i++) {
+//       unsigned int pointIdx = face0.pointMassIndices[i];
+//       if (pointIdx != i0 && pointIdx != i1) {
+//         i2 = pointIdx;
+//         break;
+//       }
+//     }
+//     unsigned int i3 = 0;
+//     for (unsigned int i = 0; i < 3; i++) {
+//       unsigned int pointIdx = face1.pointMassIndices[i];
+//       if (pointIdx != i0 && pointIdx != i1) {
+//         i3 = pointIdx;
+//         break;
+//       }
+//     }
+//     PointMass &p0 = _softbodyMesh.pointMasses[i0];
+//     PointMass &p1 = _softbodyMesh.pointMasses[i1];
+//     PointMass &p2 = _softbodyMesh.pointMasses[i2];
+//     PointMass &p3 = _softbodyMesh.pointMasses[i3];
+//
+//     // The three edges
+//     glm::vec3 eM = p1.position - p0.position;
+//     glm::vec3 eL = p2.position - p0.position;
+//     glm::vec3 eR = p3.position - p0.position;
+//
+//     // Calculate the normals
+//     glm::vec3 nL = glm::cross(eM, eL);
+//     glm::vec3 nR = glm::cross(eM, eR);
+//     float nLLength = glm::length(nL);
+//     float nRLength = glm::length(nR);
+//     if (nLLength < 0.0001f || nRLength < 0.0001f) {
+//       continue;
+//     }
+//     nL /= nLLength;
+//     nR /= nRLength;
+//
+//     // Calculate the angle
+//     float cosTheta = glm::dot(nL, nR);
+//     // clamp cosTheta to prevent NaNs
+//     cosTheta = std::max(-1.0f, std::min(1.0f, cosTheta));
+//     float arcCosSign = 0.0f;
+//     // float theta = calculateAngle(nL, nR, eM, arcCosSign);
+//     float theta = std::acos(cosTheta);
+//
+//     // Constraint
+//     float C = theta - edge.restAngle;
+//     if (std::fabs(C) < 0.0001f) {
+//       continue;
+//     }
+//
+//     // lol math is for losers
+//     glm::vec3 dP1 =
+//         ((glm::cross(eR, nL) + cosTheta * glm::cross(nR, eR)) / nRLength +
+//          (glm::cross(eL, nR) + cosTheta * glm::cross(nL, eL)) / nLLength);
+//     glm::vec3 dP2 =
+//         (glm::cross(nR, eM) - cosTheta * glm::cross(nL, eM)) / nLLength;
+//     glm::vec3 dP3 =
+//         (glm::cross(nL, eM) - cosTheta * glm::cross(nR, eM)) / nRLength;
+//     glm::vec3 dP0 = -dP1 - dP2 - dP3;
+//
+//     float dPDenomRadicand = 1.0f - cosTheta * cosTheta;
+//     float dPDenom = -arcCosSign * std::sqrt(dPDenomRadicand);
+//
+//     float lambdaDenom =
+//         p0.invMass * glm::dot(dP0, dP0) + p1.invMass * glm::dot(dP1, dP1) +
+//         p2.invMass * glm::dot(dP2, dP2) + p3.invMass * glm::dot(dP3, dP3) +
+//         alpha * dPDenomRadicand;
+//     if (std::fabs(lambdaDenom) < 0.0001f) {
+//       continue;
+//     }
+//
+//     float deltaLambdaRaw = (-C - alpha * edge.lambdaAngle) / lambdaDenom;
+//     p0.position += (p0.invMass * dPDenom * deltaLambdaRaw) * dP0;
+//     p1.position += (p1.invMass * dPDenom * deltaLambdaRaw) * dP1;
+//     p2.position += (p2.invMass * dPDenom * deltaLambdaRaw) * dP2;
+//     p3.position += (p3.invMass * dPDenom * deltaLambdaRaw) * dP3;
+//     edge.lambdaAngle += dPDenomRadicand * deltaLambdaRaw;
+//   }
+// }
+
+// float Softbody::calculateAngle(glm::vec3 nL, glm::vec3 nR, glm::vec3
+// eM,
+//                                      float &arcCosSign) {
+//   float cosTheta = glm::dot(nL, nR);
+//   float theta = 0.0f;
+//
+//   if (glm::dot(eM, glm::cross(nL, nR)) < 0.0f) {
+//     theta = (2.0f * glm::pi<float>()) - std::acos(cosTheta);
+//     arcCosSign = -1.0f;
+//   } else {
+//     theta = std::acos(cosTheta);
+//     arcCosSign = 1.0f;
+//   }
+//
+//   return theta;
+// }
+
+void Softbody::updateNormals() {
+  PROFILE_SCOPE("Softbody::updateNormals");
+  const glm::vec3 *positions = _softbodyMesh.positions.data();
+  const SoftbodyFace *faces = _softbodyMesh.faces.data();
+  const CornerAdjacency &corners = _softbodyMesh.corners;
+  ThreadPool &pool = ThreadPool::global();
+
+  // Area weighted face normals, each one computed once
+  _faceNormals.resize(_softbodyMesh.faces.size());
+  glm::vec3 *faceNormals = _faceNormals.data();
+  pool.parallelFor(_faceNormals.size(), NORMAL_GRAIN_SIZE,
+                   [&](size_t begin, size_t end) {
+                     for (size_t i = begin; i < end; i++) {
+                       const unsigned int *indices = faces[i].pointMassIndices;
+                       const glm::vec3 a = positions[indices[0]];
+                       faceNormals[i] =
+                           glm::cross(positions[indices[1]] - a,
+                                      positions[indices[2]] - a);
+                     }
+                   });
+
+  // Gather the normals of the faces around each point mass, every point mass
+  // is written by exactly one thread
+  glm::vec3 *normals = _softbodyMesh.normals.data();
+  pool.parallelFor(
+      _softbodyMesh.pointMassCount(), NORMAL_GRAIN_SIZE,
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          glm::vec3 normal(0.0f);
+          for (unsigned int j = corners.offsets[i];
+               j < corners.offsets[i + 1]; j++) {
+            normal += faceNormals[corners.faceIndices[j]];
+          }
+
+          // Point masses without area around them keep pointing up
+          const float length2 = glm::dot(normal, normal);
+          normals[i] = length2 > 0.0f ? normal * glm::inversesqrt(length2)
+                                      : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+      });
+}
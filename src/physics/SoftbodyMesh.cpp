@@ -1,17 +1,22 @@
 #include "physics/SoftbodyMesh.hpp"
 
+#include <algorithm>
+#include <cstdint>
+
 SoftbodyMesh::SoftbodyMesh(const Mesh &mesh) {
   // Create point masses
-  pointMasses.reserve(mesh._vertices.size());
+  const size_t count = mesh._vertices.size();
+  positions.reserve(count);
+  uvs.reserve(count);
+  normals.reserve(count);
   for (const auto &vertex : mesh._vertices) {
-    PointMass pointMass;
-    pointMass.position = vertex.position;
-    pointMass.uv = vertex.uv;
-    pointMass.normal = vertex.normal;
-    pointMass.velocity = glm::vec3(0.0f);
-
-    pointMasses.push_back(pointMass);
+    positions.push_back(vertex.position);
+    uvs.push_back(vertex.uv);
+    normals.push_back(vertex.normal);
   }
+  prevPositions.resize(count, glm::vec3(0.0f));
+  velocities.resize(count, glm::vec3(0.0f));
+  invMasses.resize(count, 0.0f);
 
   // Create faces
   faces.reserve(mesh._indices.size() / 3);
@@ -24,39 +29,37 @@ SoftbodyMesh::SoftbodyMesh(const Mesh &mesh) {
     faces.push_back(face);
   }
 
-  // Create edges
-  for (unsigned int i = 0; i < faces.size(); i++) {
-    for (unsigned int j = 0; j < 3; j++) {
-      const unsigned int a = faces[i].pointMassIndices[j];
-      const unsigned int b = faces[i].pointMassIndices[(j + 1) % 3];
-
-      // Check if the edge already exists
-      bool edgeExists = false;
-      for (auto &edge : edges) {
-        if ((edge.pointMassIndices[0] == a && edge.pointMassIndices[1] == b) ||
-            (edge.pointMassIndices[0] == b && edge.pointMassIndices[1] == a)) {
-          // The edge already exists, add the current face to the edge
-          edge.faceIndices[1] = i;
-          edgeExists = true;
-          break;
-        }
-      }
-      if (edgeExists) {
-        continue;
-      }
-
-      // Create a new edge
-      SoftbodyEdge edge;
-      edge.pointMassIndices[0] = a;
-      edge.pointMassIndices[1] = b;
-
-      edge.faceIndices[0] = i;
+  corners.build(faces, count);
 
-      edge.restLength =
-          glm::length(pointMasses[a].position - pointMasses[b].position);
+  // Create edges, one per pair of twin half-edges
+  halfEdges.build(faces);
+  edges.resize(halfEdges.edgeCount());
+  for (unsigned int i = 0; i < edges.size(); i++) {
+    SoftbodyEdge &edge = edges[i];
+    const unsigned int halfEdge = halfEdges.edgeHalfEdges[i];
+    const unsigned int twin = halfEdges.twins[halfEdge];
+    const SoftbodyFace &face = faces[HalfEdgeAdjacency::face(halfEdge)];
 
-      edges.push_back(edge);
+    edge.pointMassIndices[0] = face.pointMassIndices[halfEdge % 3];
+    edge.pointMassIndices[1] =
+        face.pointMassIndices[HalfEdgeAdjacency::next(halfEdge) % 3];
+    edge.neighborIndices[0] =
+        face.pointMassIndices[HalfEdgeAdjacency::prev(halfEdge) % 3];
+    edge.faceIndices[0] = HalfEdgeAdjacency::face(halfEdge);
+    if (twin == HalfEdgeAdjacency::NONE) {
+      edge.faceIndices[1] = edge.faceIndices[0];
+      edge.neighborIndices[1] = edge.neighborIndices[0];
+    } else {
+      edge.faceIndices[1] = HalfEdgeAdjacency::face(twin);
+      edge.neighborIndices[1] =
+          faces[edge.faceIndices[1]]
+              .pointMassIndices[HalfEdgeAdjacency::prev(twin) % 3];
     }
+
+    edge.restLength = glm::length(positions[edge.pointMassIndices[0]] -
+                                  positions[edge.pointMassIndices[1]]);
+    edge.restSpanLength = glm::length(positions[edge.neighborIndices[0]] -
+                                      positions[edge.neighborIndices[1]]);
   }
 
   // Calculate the rest angles of the edges
@@ -99,43 +102,25 @@ SoftbodyMesh::SoftbodyMesh(const Mesh &mesh) {
   //   edge.restAngle = std::acos(glm::dot(n0, n1));
   // }
 
-  // Calculate the rest span length of the faces
-  for (auto &edge : edges) {
-    const unsigned int i0 = edge.pointMassIndices[0];
-    const unsigned int i1 = edge.pointMassIndices[1];
-    unsigned int iL = 0;
-    for (unsigned int i = 0; i < 3; i++) {
-      unsigned int pointIdx = faces[edge.faceIndices[0]].pointMassIndices[i];
-      if (pointIdx != i0 && pointIdx != i1) {
-        iL = pointIdx;
-        break;
-      }
-    }
-    unsigned int iR = 0;
-    for (unsigned int i = 0; i < 3; i++) {
-      unsigned int pointIdx = faces[edge.faceIndices[1]].pointMassIndices[i];
-      if (pointIdx != i0 && pointIdx != i1) {
-        iR = pointIdx;
-        break;
-      }
-    }
-
-    // The two points of the faces that are not part of the edge
-    edge.neighborIndices[0] = iL;
-    edge.neighborIndices[1] = iR;
-    const PointMass &pL = pointMasses[iL];
-    const PointMass &pR = pointMasses[iR];
-
-    // Calculate the rest span length
-    edge.restSpanLength = glm::length(pL.position - pR.position);
+  // Color the constraints so each color can be solved in parallel
+  std::vector<std::pair<unsigned int, unsigned int>> lengthPairs;
+  std::vector<std::pair<unsigned int, unsigned int>> spanPairs;
+  lengthPairs.reserve(edges.size());
+  spanPairs.reserve(edges.size());
+  for (const auto &edge : edges) {
+    lengthPairs.emplace_back(edge.pointMassIndices[0],
+                             edge.pointMassIndices[1]);
+    spanPairs.emplace_back(edge.neighborIndices[0], edge.neighborIndices[1]);
   }
+  lengthColoring.build(lengthPairs, positions.size());
+  spanColoring.build(spanPairs, positions.size());
 
   // Calculate the volume of the mesh
   restVolume = 0.0f;
   for (const auto &face : faces) {
-    const glm::vec3 &a = pointMasses[face.pointMassIndices[0]].position;
-    const glm::vec3 &b = pointMasses[face.pointMassIndices[1]].position;
-    const glm::vec3 &c = pointMasses[face.pointMassIndices[2]].position;
+    const glm::vec3 &a = positions[face.pointMassIndices[0]];
+    const glm::vec3 &b = positions[face.pointMassIndices[1]];
+    const glm::vec3 &c = positions[face.pointMassIndices[2]];
 
     const float volume = glm::dot(a, glm::cross(b, c)) / 6.0f;
     restVolume += volume;
@@ -143,26 +128,26 @@ SoftbodyMesh::SoftbodyMesh(const Mesh &mesh) {
     // Calculate the inverse mass
     const float mass = volume / 3.0f;
     for (unsigned int i = 0; i < 3; i++) {
-      pointMasses[face.pointMassIndices[i]].invMass += mass;
+      invMasses[face.pointMassIndices[i]] += mass;
     }
   }
+  faceOrientation = restVolume < 0.0f ? -1.0f : 1.0f;
   restVolume = std::fabs(restVolume);
 
   // Cap the inverse mass at 4 times the target to prevent instability
-  const float targetInvMass = pointMasses.size() / restVolume;
-  for (auto &pointMass : pointMasses) {
-    pointMass.invMass = 1.0f / pointMass.invMass;
-    pointMass.invMass =
-        std::min(std::fabs(pointMass.invMass), targetInvMass * 4.0f);
+  const float targetInvMass = positions.size() / restVolume;
+  for (auto &invMass : invMasses) {
+    invMass = 1.0f / invMass;
+    invMass = std::min(std::fabs(invMass), targetInvMass * 4.0f);
   }
 }
 
 float SoftbodyMesh::calculateVolume() const {
   float currentVolume = 0.0f;
   for (const auto &face : faces) {
-    const glm::vec3 &a = pointMasses[face.pointMassIndices[0]].position;
-    const glm::vec3 &b = pointMasses[face.pointMassIndices[1]].position;
-    const glm::vec3 &c = pointMasses[face.pointMassIndices[2]].position;
+    const glm::vec3 &a = positions[face.pointMassIndices[0]];
+    const glm::vec3 &b = positions[face.pointMassIndices[1]];
+    const glm::vec3 &c = positions[face.pointMassIndices[2]];
 
     currentVolume += glm::dot(a, glm::cross(b, c)) / 6.0f;
   }
@@ -172,9 +157,159 @@ float SoftbodyMesh::calculateVolume() const {
 
 glm::vec3 SoftbodyMesh::getCenter() const {
   glm::vec3 center(0.0f);
-  for (const auto &pointMass : pointMasses) {
-    center += pointMass.position;
+  for (const auto &position : positions) {
+    center += position;
+  }
+
+  return center / static_cast<float>(positions.size());
+}
+
+void HalfEdgeAdjacency::build(const std::vector<SoftbodyFace> &faces) {
+  const size_t halfEdgeCount = faces.size() * 3;
+  twins.assign(halfEdgeCount, NONE);
+  edgeIndices.resize(halfEdgeCount);
+  edgeHalfEdges.clear();
+
+  // Power of two with at most half of the slots in use
+  size_t tableSize = 1;
+  while (tableSize < halfEdgeCount * 2) {
+    tableSize *= 2;
+  }
+  const uint64_t emptyKey = ~uint64_t(0);
+  std::vector<uint64_t> keys(tableSize, emptyKey);
+  std::vector<unsigned int> slotEdges(tableSize);
+
+  for (unsigned int h = 0; h < halfEdgeCount; h++) {
+    const unsigned int *corners = faces[face(h)].pointMassIndices;
+    unsigned int a = corners[h % 3];
+    unsigned int b = corners[next(h) % 3];
+    if (a > b) {
+      std::swap(a, b);
+    }
+    const uint64_t key = (uint64_t(a) << 32) | b;
+
+    // Fibonacci hashing, then linear probing
+    size_t slot = ((key * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+    while (keys[slot] != emptyKey && keys[slot] != key) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+
+    if (keys[slot] == emptyKey) {
+      keys[slot] = key;
+      slotEdges[slot] = static_cast<unsigned int>(edgeHalfEdges.size());
+      edgeIndices[h] = slotEdges[slot];
+      edgeHalfEdges.push_back(h);
+      continue;
+    }
+
+    const unsigned int edge = slotEdges[slot];
+    const unsigned int first = edgeHalfEdges[edge];
+    edgeIndices[h] = edge;
+    if (twins[first] == NONE) {
+      twins[first] = h;
+      twins[h] = first;
+    }
+  }
+}
+
+void CornerAdjacency::build(const std::vector<SoftbodyFace> &faces,
+                            size_t pointMassCount) {
+  offsets.assign(pointMassCount + 1, 0);
+  for (const auto &face : faces) {
+    for (unsigned int pointMassIndex : face.pointMassIndices) {
+      offsets[pointMassIndex + 1]++;
+    }
+  }
+  for (size_t i = 0; i < pointMassCount; i++) {
+    offsets[i + 1] += offsets[i];
+  }
+
+  // Fill in face order, so the result does not depend on anything else
+  oppositeEdges.resize(faces.size() * 3);
+  faceIndices.resize(faces.size() * 3);
+  std::vector<unsigned int> cursors(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < faces.size(); i++) {
+    const unsigned int *indices = faces[i].pointMassIndices;
+    for (unsigned int j = 0; j < 3; j++) {
+      const unsigned int corner = cursors[indices[j]]++;
+      oppositeEdges[corner] = {indices[(j + 1) % 3], indices[(j + 2) % 3]};
+      faceIndices[corner] = i;
+    }
+  }
+}
+
+namespace {
+
+// Greedily colors constraints of pointsPerConstraint point masses each,
+// pointMassIndex(i, k) being point mass k of constraint i
+template <typename PointMassIndex>
+void colorConstraints(ConstraintColoring &coloring, size_t constraintCount,
+                      unsigned int pointsPerConstraint,
+                      PointMassIndex pointMassIndex, size_t pointMassCount) {
+  // Colors already used by the constraints touching each point mass
+  std::vector<std::vector<unsigned int>> usedColors(pointMassCount);
+  std::vector<unsigned int> colors(constraintCount);
+  std::vector<unsigned int> colorSizes;
+
+  for (size_t i = 0; i < constraintCount; i++) {
+    // Pick the lowest color none of the point masses has seen yet
+    const auto isUsed = [&](unsigned int color) {
+      for (unsigned int k = 0; k < pointsPerConstraint; k++) {
+        const std::vector<unsigned int> &used =
+            usedColors[pointMassIndex(i, k)];
+        if (std::find(used.begin(), used.end(), color) != used.end()) {
+          return true;
+        }
+      }
+      return false;
+    };
+    unsigned int color = 0;
+    while (isUsed(color)) {
+      color++;
+    }
+
+    colors[i] = color;
+    for (unsigned int k = 0; k < pointsPerConstraint; k++) {
+      usedColors[pointMassIndex(i, k)].push_back(color);
+    }
+    if (color >= colorSizes.size()) {
+      colorSizes.resize(color + 1, 0);
+    }
+    colorSizes[color]++;
   }
 
-  return center / static_cast<float>(pointMasses.size());
+  // Bucket the constraints by color
+  coloring.colorOffsets.assign(colorSizes.size() + 1, 0);
+  for (size_t c = 0; c < colorSizes.size(); c++) {
+    coloring.colorOffsets[c + 1] = coloring.colorOffsets[c] + colorSizes[c];
+  }
+
+  coloring.constraintIndices.resize(constraintCount);
+  std::vector<unsigned int> cursor(coloring.colorOffsets.begin(),
+                                   coloring.colorOffsets.end() - 1);
+  for (size_t i = 0; i < constraintCount; i++) {
+    coloring.constraintIndices[cursor[colors[i]]++] = i;
+  }
+}
+
+} // namespace
+
+void ConstraintColoring::build(
+    const std::vector<std::pair<unsigned int, unsigned int>> &pointMassIndices,
+    size_t pointMassCount) {
+  colorConstraints(
+      *this, pointMassIndices.size(), 2,
+      [&](size_t i, unsigned int k) {
+        return k == 0 ? pointMassIndices[i].first : pointMassIndices[i].second;
+      },
+      pointMassCount);
+}
+
+void ConstraintColoring::build(
+    const std::vector<std::array<unsigned int, 4>> &pointMassIndices,
+    size_t pointMassCount) {
+  colorConstraints(
+      *this, pointMassIndices.size(), 4,
+      [&](size_t i, unsigned int k) { return pointMassIndices[i][k]; },
+      pointMassCount);
 }
@@ -0,0 +1,331 @@
+#include "physics/SoftbodyMeshCache.hpp"
+
+#include "core/MappedFile.hpp"
+#include "core/ObjLoader.hpp"
+
+#include "physics/SoftbodyMesh.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+
+constexpr char MAGIC[8] = {'S', 'B', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+// The arrays of the file, in the order they are stored
+enum Section : uint32_t {
+  POSITIONS,
+  INV_MASSES,
+  UVS,
+  NORMALS,
+  FACES,
+  EDGES,
+  TWINS,
+  EDGE_INDICES,
+  EDGE_HALF_EDGES,
+  LENGTH_CONSTRAINTS,
+  LENGTH_OFFSETS,
+  SPAN_CONSTRAINTS,
+  SPAN_OFFSETS,
+  MATERIAL_FILES, // Null separated paths
+  SECTION_COUNT
+};
+
+struct SectionRange {
+  uint64_t offset;
+  uint64_t size; // In bytes
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sectionCount;
+  // The size and modification time of the source when the cache was written
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  float restVolume;
+  float faceOrientation;
+  SectionRange sections[SECTION_COUNT];
+};
+
+static_assert(std::is_trivially_copyable<SoftbodyEdge>::value &&
+                  std::is_trivially_copyable<SoftbodyFace>::value,
+              "Cached structs are written as raw bytes");
+
+uint64_t alignUp(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+class Writer {
+public:
+  void add(Section section, const void *data, size_t size) {
+    _header.sections[section] = {alignUp(_body.size()), size};
+    _body.resize(alignUp(_body.size()) + size);
+    if (size > 0) {
+      std::memcpy(_body.data() + _header.sections[section].offset, data, size);
+    }
+  }
+  template <typename T> void add(Section section, const std::vector<T> &array) {
+    add(section, array.data(), array.size() * sizeof(T));
+  }
+
+  Header &header() { return _header; }
+
+  bool write(const std::string &path) {
+    // Section offsets are relative to the end of the header
+    const uint64_t headerSize = alignUp(sizeof(Header));
+    for (auto &section : _header.sections) {
+      section.offset += headerSize;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    std::vector<char> padding(headerSize - sizeof(Header), 0);
+    file.write(reinterpret_cast<const char *>(&_header), sizeof(Header));
+    file.write(padding.data(), padding.size());
+    file.write(_body.data(), _body.size());
+    return file.good();
+  }
+
+private:
+  Header _header{};
+  std::vector<char> _body;
+};
+
+class Reader {
+public:
+  Reader(const MappedFile &file, const Header &header)
+      : _file(file), _header(header) {}
+
+  template <typename T> bool read(Section section, std::vector<T> &out) {
+    const SectionRange &range = _header.sections[section];
+    if (range.offset > _file.size() ||
+        range.size > _file.size() - range.offset ||
+        range.size % sizeof(T) != 0) {
+      return false;
+    }
+    out.resize(range.size / sizeof(T));
+    if (range.size > 0) {
+      std::memcpy(out.data(), _file.data() + range.offset, range.size);
+    }
+    return true;
+  }
+
+private:
+  const MappedFile &_file;
+  const Header &_header;
+};
+
+// True if every index is below limit, or NONE where that is allowed
+bool indicesBelow(const unsigned int *indices, size_t count, size_t limit,
+                  bool allowNone = false) {
+  for (size_t i = 0; i < count; i++) {
+    if (indices[i] >= limit &&
+        !(allowNone && indices[i] == HalfEdgeAdjacency::NONE)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The colors have to cover constraintIndices in ascending ranges, and every
+// constraint index has to be below constraintCount
+bool isValidColoring(const ConstraintColoring &coloring,
+                     size_t constraintCount) {
+  const std::vector<unsigned int> &offsets = coloring.colorOffsets;
+  if (offsets.empty() || offsets.front() != 0 ||
+      offsets.back() != coloring.constraintIndices.size() ||
+      !std::is_sorted(offsets.begin(), offsets.end())) {
+    return false;
+  }
+  return indicesBelow(coloring.constraintIndices.data(),
+                      coloring.constraintIndices.size(), constraintCount);
+}
+
+// Everything the solver indexes with has to stay in bounds, a cache that
+// fails this is rebuilt
+bool isValidMesh(const SoftbodyMesh &mesh) {
+  const size_t count = mesh.pointMassCount();
+  if (mesh.invMasses.size() != count || mesh.uvs.size() != count ||
+      mesh.normals.size() != count) {
+    return false;
+  }
+
+  const size_t faceCount = mesh.faces.size();
+  for (const auto &face : mesh.faces) {
+    if (!indicesBelow(face.pointMassIndices, 3, count)) {
+      return false;
+    }
+  }
+
+  const size_t edgeCount = mesh.edges.size();
+  for (const auto &edge : mesh.edges) {
+    if (!indicesBelow(edge.pointMassIndices, 2, count) ||
+        !indicesBelow(edge.faceIndices, 2, faceCount) ||
+        !indicesBelow(edge.neighborIndices, 2, count)) {
+      return false;
+    }
+  }
+
+  const HalfEdgeAdjacency &halfEdges = mesh.halfEdges;
+  const size_t halfEdgeCount = faceCount * 3;
+  if (halfEdges.twins.size() != halfEdgeCount ||
+      halfEdges.edgeIndices.size() != halfEdgeCount ||
+      halfEdges.edgeHalfEdges.size() != edgeCount ||
+      !indicesBelow(halfEdges.twins.data(), halfEdgeCount, halfEdgeCount,
+                    true) ||
+      !indicesBelow(halfEdges.edgeIndices.data(), halfEdgeCount, edgeCount) ||
+      !indicesBelow(halfEdges.edgeHalfEdges.data(), edgeCount,
+                    halfEdgeCount)) {
+    return false;
+  }
+
+  return isValidColoring(mesh.lengthColoring, edgeCount) &&
+         isValidColoring(mesh.spanColoring, edgeCount);
+}
+
+} // namespace
+
+void SoftbodyMeshCache::loadOrBuild(
+    const std::string &filename, SoftbodyMesh &out_mesh,
+    std::vector<std::string> &out_materialFiles) {
+  if (load(filename, out_mesh, out_materialFiles)) {
+    return;
+  }
+
+  Mesh mesh;
+  // One point mass per point in space, so uv seams cannot tear open
+  ObjLoader::loadMesh(filename, mesh, VertexWeld::POSITION_ONLY);
+  out_mesh = SoftbodyMesh(mesh);
+  out_materialFiles.clear();
+  ObjLoader::findMaterialFiles(filename, out_materialFiles);
+
+  // A read-only asset directory only costs the speed up
+  save(filename, out_mesh, out_materialFiles);
+}
+
+bool SoftbodyMeshCache::load(const std::string &filename,
+                             SoftbodyMesh &out_mesh,
+                             std::vector<std::string> &out_materialFiles) {
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  if (!statFile(filename, sourceSize, sourceTime)) {
+    return false;
+  }
+
+  const MappedFile file(cachePath(filename));
+  if (!file.isOpen() || file.size() < sizeof(Header)) {
+    return false;
+  }
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.sectionCount != SECTION_COUNT ||
+      header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+    return false;
+  }
+
+  SoftbodyMesh mesh;
+  std::vector<char> materialFiles;
+  Reader reader(file, header);
+  if (!reader.read(POSITIONS, mesh.positions) ||
+      !reader.read(INV_MASSES, mesh.invMasses) ||
+      !reader.read(UVS, mesh.uvs) || !reader.read(NORMALS, mesh.normals) ||
+      !reader.read(FACES, mesh.faces) || !reader.read(EDGES, mesh.edges) ||
+      !reader.read(TWINS, mesh.halfEdges.twins) ||
+      !reader.read(EDGE_INDICES, mesh.halfEdges.edgeIndices) ||
+      !reader.read(EDGE_HALF_EDGES, mesh.halfEdges.edgeHalfEdges) ||
+      !reader.read(LENGTH_CONSTRAINTS, mesh.lengthColoring.constraintIndices) ||
+      !reader.read(LENGTH_OFFSETS, mesh.lengthColoring.colorOffsets) ||
+      !reader.read(SPAN_CONSTRAINTS, mesh.spanColoring.constraintIndices) ||
+      !reader.read(SPAN_OFFSETS, mesh.spanColoring.colorOffsets) ||
+      !reader.read(MATERIAL_FILES, materialFiles)) {
+    return false;
+  }
+
+  if (!isValidMesh(mesh)) {
+    return false;
+  }
+  const size_t count = mesh.pointMassCount();
+  mesh.corners.build(mesh.faces, count);
+  mesh.prevPositions.resize(count, glm::vec3(0.0f));
+  mesh.velocities.resize(count, glm::vec3(0.0f));
+  mesh.restVolume = header.restVolume;
+  mesh.faceOrientation = header.faceOrientation;
+
+  out_materialFiles.clear();
+  for (size_t begin = 0; begin < materialFiles.size();) {
+    const size_t end = std::find(materialFiles.begin() + begin,
+                                 materialFiles.end(), '\0') -
+                       materialFiles.begin();
+    out_materialFiles.emplace_back(materialFiles.begin() + begin,
+                                   materialFiles.begin() + end);
+    begin = end + 1;
+  }
+
+  out_mesh = std::move(mesh);
+  return true;
+}
+
+bool SoftbodyMeshCache::save(const std::string &filename,
+                             const SoftbodyMesh &mesh,
+                             const std::vector<std::string> &materialFiles) {
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  if (!statFile(filename, sourceSize, sourceTime)) {
+    return false;
+  }
+
+  std::vector<char> materialData;
+  for (const auto &materialFile : materialFiles) {
+    materialData.insert(materialData.end(), materialFile.begin(),
+                        materialFile.end());
+    materialData.push_back('\0');
+  }
+
+  Writer writer;
+  Header &header = writer.header();
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.sectionCount = SECTION_COUNT;
+  header.sourceSize = sourceSize;
+  header.sourceTime = sourceTime;
+  header.restVolume = mesh.restVolume;
+  header.faceOrientation = mesh.faceOrientation;
+
+  writer.add(POSITIONS, mesh.positions);
+  writer.add(INV_MASSES, mesh.invMasses);
+  writer.add(UVS, mesh.uvs);
+  writer.add(NORMALS, mesh.normals);
+  writer.add(FACES, mesh.faces);
+  writer.add(EDGES, mesh.edges);
+  writer.add(TWINS, mesh.halfEdges.twins);
+  writer.add(EDGE_INDICES, mesh.halfEdges.edgeIndices);
+  writer.add(EDGE_HALF_EDGES, mesh.halfEdges.edgeHalfEdges);
+  writer.add(LENGTH_CONSTRAINTS, mesh.lengthColoring.constraintIndices);
+  writer.add(LENGTH_OFFSETS, mesh.lengthColoring.colorOffsets);
+  writer.add(SPAN_CONSTRAINTS, mesh.spanColoring.constraintIndices);
+  writer.add(SPAN_OFFSETS, mesh.spanColoring.colorOffsets);
+  writer.add(MATERIAL_FILES, materialData);
+
+  return writer.write(cachePath(filename));
+}
+
+bool SoftbodyMeshCache::statFile(const std::string &filename,
+                                 uint64_t &out_size, int64_t &out_time) {
+  std::error_code error;
+  const auto size = std::filesystem::file_size(filename, error);
+  if (error) {
+    return false;
+  }
+  const auto time = std::filesystem::last_write_time(filename, error);
+  if (error) {
+    return false;
+  }
+  out_size = static_cast<uint64_t>(size);
+  out_time = static_cast<int64_t>(time.time_since_epoch().count());
+  return true;
+}
@@ -0,0 +1,120 @@
+#include "physics/SpatialHash.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+bool SpatialHash::cellRange(const AABB &box, int (&lo)[3],
+                            int (&hi)[3]) const {
+  double cells = 1.0;
+  for (int i = 0; i < 3; i++) {
+    lo[i] = static_cast<int>(std::floor(box.min[i] / _cellSize));
+    hi[i] = static_cast<int>(std::floor(box.max[i] / _cellSize));
+    cells *= static_cast<double>(hi[i]) - lo[i] + 1.0;
+  }
+  return cells <= _tableSize;
+}
+
+unsigned int SpatialHash::hashCell(int x, int y, int z) const {
+  // Unsigned, so the products wrap around instead of overflowing
+  const uint32_t h = (static_cast<uint32_t>(x) * 92837111u) ^
+                     (static_cast<uint32_t>(y) * 689287499u) ^
+                     (static_cast<uint32_t>(z) * 283923481u);
+  return h % _tableSize;
+}
+
+void SpatialHash::build(const std::vector<AABB> &boxes) {
+  _boxes = boxes;
+  _largeBoxes.clear();
+  _cellStart.assign(_tableSize + 1, 0);
+
+  // Count the entries of every cell
+  int lo[3], hi[3];
+  for (unsigned int id = 0; id < _boxes.size(); id++) {
+    if (!cellRange(_boxes[id], lo, hi)) {
+      _largeBoxes.push_back(id);
+      continue;
+    }
+    for (int x = lo[0]; x <= hi[0]; x++) {
+      for (int y = lo[1]; y <= hi[1]; y++) {
+        for (int z = lo[2]; z <= hi[2]; z++) {
+          _cellStart[hashCell(x, y, z)]++;
+        }
+      }
+    }
+  }
+
+  // Prefix sum, each cell start points past its end for now
+  for (unsigned int h = 0; h < _tableSize; h++) {
+    _cellStart[h + 1] += _cellStart[h];
+  }
+
+  // Fill the cells back to front, leaving the starts in place
+  _cellEntries.resize(_cellStart[_tableSize]);
+  for (unsigned int id = 0; id < _boxes.size(); id++) {
+    if (!cellRange(_boxes[id], lo, hi)) {
+      continue;
+    }
+    for (int x = lo[0]; x <= hi[0]; x++) {
+      for (int y = lo[1]; y <= hi[1]; y++) {
+        for (int z = lo[2]; z <= hi[2]; z++) {
+          _cellEntries[--_cellStart[hashCell(x, y, z)]] = id;
+        }
+      }
+    }
+  }
+
+  _stamps.assign(_boxes.size(), 0);
+  _stamp = 0;
+}
+
+void SpatialHash::query(const AABB &box, std::vector<unsigned int> &out) {
+  out.clear();
+  if (_boxes.empty()) {
+    return;
+  }
+
+  _stamp++;
+  auto report = [&](unsigned int id) {
+    if (_stamps[id] != _stamp && _boxes[id].overlaps(box)) {
+      out.push_back(id);
+    }
+    _stamps[id] = _stamp;
+  };
+
+  for (auto id : _largeBoxes) {
+    report(id);
+  }
+
+  int lo[3], hi[3];
+  if (!cellRange(box, lo, hi)) {
+    // Cheaper to check every box than to walk that many cells
+    for (unsigned int id = 0; id < _boxes.size(); id++) {
+      report(id);
+    }
+    return;
+  }
+
+  for (int x = lo[0]; x <= hi[0]; x++) {
+    for (int y = lo[1]; y <= hi[1]; y++) {
+      for (int z = lo[2]; z <= hi[2]; z++) {
+        const unsigned int h = hashCell(x, y, z);
+        for (unsigned int i = _cellStart[h]; i < _cellStart[h + 1]; i++) {
+          report(_cellEntries[i]);
+        }
+      }
+    }
+  }
+}
+
+void SpatialHash::findPairs(
+    std::vector<std::pair<unsigned int, unsigned int>> &out) {
+  out.clear();
+  for (unsigned int id = 0; id < _boxes.size(); id++) {
+    query(_boxes[id], _hits);
+    for (auto other : _hits) {
+      if (other > id) {
+        out.emplace_back(id, other);
+      }
+    }
+  }
+}
@@ -0,0 +1,318 @@
+#include "physics/TetMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+// The corners of the 6 tets of a cell, as offsets along x, y and z. Each tet
+// walks from the lowest corner to the highest one along the axes in a
+// different order, so every tet has the main diagonal as an edge.
+constexpr int CELL_TETS[6][4][3] = {
+    {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}},
+    {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {1, 1, 1}},
+    {{0, 0, 0}, {0, 1, 0}, {1, 1, 0}, {1, 1, 1}},
+    {{0, 0, 0}, {0, 1, 0}, {0, 1, 1}, {1, 1, 1}},
+    {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 1, 1}},
+    {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {1, 1, 1}},
+};
+
+// Six times the signed volume of a tet
+float tetVolume(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2,
+                const glm::vec3 &p3) {
+  return glm::dot(glm::cross(p1 - p0, p2 - p0), p3 - p0);
+}
+
+// The barycentric weights of point in a tet, the tet must not be flat
+glm::vec4 barycentricWeights(const glm::vec3 &point, const glm::vec3 &p0,
+                             const glm::vec3 &p1, const glm::vec3 &p2,
+                             const glm::vec3 &p3) {
+  const glm::mat3 edges(p1 - p0, p2 - p0, p3 - p0);
+  const glm::vec3 weights = glm::inverse(edges) * (point - p0);
+  return glm::vec4(1.0f - weights.x - weights.y - weights.z, weights);
+}
+
+} // namespace
+
+TetMesh::TetMesh(const SoftbodyMesh &surface, int resolution) {
+  if (surface.positions.empty() || surface.faces.empty()) {
+    return;
+  }
+
+  // Lay out the grid, it overhangs the surface bounds by at least half a cell
+  glm::vec3 min = surface.positions[0];
+  glm::vec3 max = surface.positions[0];
+  for (const auto &position : surface.positions) {
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+  const glm::vec3 extent = max - min;
+  const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+  if (longest <= 0.0f) {
+    return;
+  }
+  const float cellSize = longest / std::max(resolution, 1);
+  const glm::ivec3 cells = glm::ivec3(extent / cellSize) + 1;
+  const glm::vec3 origin =
+      (min + max) * 0.5f - glm::vec3(cells) * cellSize * 0.5f;
+  const auto cellIndex = [&](int x, int y, int z) {
+    return (size_t)x + (size_t)cells.x * (y + (size_t)cells.y * z);
+  };
+  std::vector<bool> solid((size_t)cells.x * cells.y * cells.z, false);
+
+  // Find the cells with their center inside the surface by casting a ray
+  // along x through every row of cell centers and counting the crossings.
+  // The rays are nudged off the centers so they do not run exactly through
+  // edges and vertices of the surface.
+  const glm::vec2 nudge = glm::vec2(0.000123f, 0.000457f) * cellSize;
+  std::vector<std::vector<unsigned int>> rowFaces((size_t)cells.y * cells.z);
+  for (unsigned int f = 0; f < surface.faces.size(); f++) {
+    const unsigned int *indices = surface.faces[f].pointMassIndices;
+    glm::vec3 faceMin = surface.positions[indices[0]];
+    glm::vec3 faceMax = faceMin;
+    for (int i = 1; i < 3; i++) {
+      faceMin = glm::min(faceMin, surface.positions[indices[i]]);
+      faceMax = glm::max(faceMax, surface.positions[indices[i]]);
+    }
+    // Rows whose center is within a cell of the face, the exact test below
+    // sorts out the rest
+    const glm::ivec3 first = glm::max(
+        glm::ivec3(glm::floor((faceMin - origin) / cellSize - 0.5f)),
+        glm::ivec3(0));
+    const glm::ivec3 last =
+        glm::min(glm::ivec3(glm::ceil((faceMax - origin) / cellSize - 0.5f)),
+                 cells - 1);
+    for (int z = first.z; z <= last.z; z++) {
+      for (int y = first.y; y <= last.y; y++) {
+        rowFaces[y + (size_t)cells.y * z].push_back(f);
+      }
+    }
+  }
+
+  std::vector<float> crossings;
+  for (int z = 0; z < cells.z; z++) {
+    for (int y = 0; y < cells.y; y++) {
+      const glm::vec2 ray =
+          glm::vec2(origin.y + (y + 0.5f) * cellSize,
+                    origin.z + (z + 0.5f) * cellSize) +
+          nudge;
+      crossings.clear();
+      for (unsigned int f : rowFaces[y + (size_t)cells.y * z]) {
+        const unsigned int *indices = surface.faces[f].pointMassIndices;
+        const glm::vec3 &a = surface.positions[indices[0]];
+        const glm::vec3 &b = surface.positions[indices[1]];
+        const glm::vec3 &c = surface.positions[indices[2]];
+
+        // Barycentric coordinates of the ray in the face projected onto yz
+        const glm::vec2 ab(b.y - a.y, b.z - a.z);
+        const glm::vec2 ac(c.y - a.y, c.z - a.z);
+        const glm::vec2 ap(ray.x - a.y, ray.y - a.z);
+        const float area = ab.x * ac.y - ab.y * ac.x;
+        if (area == 0.0f) {
+          continue;
+        }
+        const float u = (ap.x * ac.y - ap.y * ac.x) / area;
+        const float v = (ab.x * ap.y - ab.y * ap.x) / area;
+        if (u < 0.0f || v < 0.0f || u + v > 1.0f) {
+          continue;
+        }
+        crossings.push_back(a.x + u * (b.x - a.x) + v * (c.x - a.x));
+      }
+      std::sort(crossings.begin(), crossings.end());
+
+      size_t crossed = 0;
+      for (int x = 0; x < cells.x; x++) {
+        const float center = origin.x + (x + 0.5f) * cellSize;
+        while (crossed < crossings.size() && crossings[crossed] < center) {
+          crossed++;
+        }
+        solid[cellIndex(x, y, z)] = crossed % 2 == 1;
+      }
+    }
+  }
+
+  const std::vector<bool> inside = solid;
+
+  // Every surface point mass needs a tet to follow
+  std::vector<glm::ivec3> pointMassCells(surface.pointMassCount());
+  for (size_t i = 0; i < surface.pointMassCount(); i++) {
+    pointMassCells[i] = glm::clamp(
+        glm::ivec3(glm::floor((surface.positions[i] - origin) / cellSize)),
+        glm::ivec3(0), cells - 1);
+    const glm::ivec3 &cell = pointMassCells[i];
+    solid[cellIndex(cell.x, cell.y, cell.z)] = true;
+  }
+
+  // Split the solid cells into tets, creating a particle for every grid node
+  // on the way
+  const glm::ivec3 nodes = cells + 1;
+  std::vector<unsigned int> nodeParticles((size_t)nodes.x * nodes.y * nodes.z,
+                                          ~0u);
+  std::vector<unsigned int> cellTets(solid.size(), ~0u); // First tet of a cell
+  std::vector<float> masses;
+  for (int z = 0; z < cells.z; z++) {
+    for (int y = 0; y < cells.y; y++) {
+      for (int x = 0; x < cells.x; x++) {
+        const size_t cell = cellIndex(x, y, z);
+        if (!solid[cell]) {
+          continue;
+        }
+        cellTets[cell] = tets.size();
+        for (const auto &corners : CELL_TETS) {
+          Tet tet;
+          for (int i = 0; i < 4; i++) {
+            const glm::ivec3 node = glm::ivec3(x, y, z) +
+                                    glm::ivec3(corners[i][0], corners[i][1],
+                                               corners[i][2]);
+            unsigned int &particle =
+                nodeParticles[node.x + (size_t)nodes.x *
+                                           (node.y + (size_t)nodes.y * node.z)];
+            if (particle == ~0u) {
+              particle = positions.size();
+              positions.push_back(origin + glm::vec3(node) * cellSize);
+              masses.push_back(0.0f);
+            }
+            tet.particleIndices[i] = particle;
+          }
+
+          const unsigned int *indices = tet.particleIndices;
+          tet.restVolume =
+              tetVolume(positions[indices[0]], positions[indices[1]],
+                        positions[indices[2]], positions[indices[3]]);
+          // Unit density, a quarter of the tet to each of its corners
+          for (int i = 0; i < 4; i++) {
+            masses[indices[i]] += std::fabs(tet.restVolume) / 24.0f;
+          }
+          tets.push_back(tet);
+        }
+      }
+    }
+  }
+
+  // Nodes with all of the cells around them inside are inside as well
+  for (int z = 1; z < cells.z; z++) {
+    for (int y = 1; y < cells.y; y++) {
+      for (int x = 1; x < cells.x; x++) {
+        bool surrounded = true;
+        for (int i = 0; i < 8 && surrounded; i++) {
+          surrounded = inside[cellIndex(x - (i & 1), y - (i >> 1 & 1),
+                                        z - (i >> 2 & 1))];
+        }
+        if (surrounded) {
+          interiorParticles.push_back(
+              nodeParticles[x + (size_t)nodes.x * (y + (size_t)nodes.y * z)]);
+        }
+      }
+    }
+  }
+
+  const size_t count = positions.size();
+  prevPositions.resize(count, glm::vec3(0.0f));
+  velocities.resize(count, glm::vec3(0.0f));
+  invMasses.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    invMasses[i] = 1.0f / masses[i];
+  }
+
+  // The edges of the tets, the ones shared by several tets only once
+  std::vector<uint64_t> edgeKeys;
+  edgeKeys.reserve(tets.size() * 6);
+  for (const auto &tet : tets) {
+    const unsigned int *indices = tet.particleIndices;
+    for (int i = 0; i < 4; i++) {
+      for (int j = i + 1; j < 4; j++) {
+        const uint64_t a = std::min(indices[i], indices[j]);
+        const uint64_t b = std::max(indices[i], indices[j]);
+        edgeKeys.push_back(a << 32 | b);
+      }
+    }
+  }
+  std::sort(edgeKeys.begin(), edgeKeys.end());
+  edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()),
+                 edgeKeys.end());
+
+  std::vector<std::pair<unsigned int, unsigned int>> edgeParticles;
+  edgeParticles.reserve(edgeKeys.size());
+  edges.reserve(edgeKeys.size());
+  for (uint64_t key : edgeKeys) {
+    TetEdge edge;
+    edge.particleIndices[0] = (unsigned int)(key >> 32);
+    edge.particleIndices[1] = (unsigned int)key;
+    edge.restLength = glm::length(positions[edge.particleIndices[0]] -
+                                  positions[edge.particleIndices[1]]);
+    edges.push_back(edge);
+    edgeParticles.emplace_back(edge.particleIndices[0],
+                               edge.particleIndices[1]);
+  }
+  edgeColoring.build(edgeParticles, count);
+
+  std::vector<std::array<unsigned int, 4>> tetParticles;
+  tetParticles.reserve(tets.size());
+  for (const auto &tet : tets) {
+    tetParticles.push_back({tet.particleIndices[0], tet.particleIndices[1],
+                            tet.particleIndices[2], tet.particleIndices[3]});
+  }
+  tetColoring.build(tetParticles, count);
+
+  // Embed every surface point mass in the tet of its cell it is the deepest
+  // inside of
+  embeddings.resize(surface.pointMassCount());
+  for (size_t i = 0; i < surface.pointMassCount(); i++) {
+    const glm::ivec3 &cell = pointMassCells[i];
+    const unsigned int firstTet = cellTets[cellIndex(cell.x, cell.y, cell.z)];
+    float bestDepth = -std::numeric_limits<float>::infinity();
+    for (unsigned int t = firstTet; t < firstTet + 6; t++) {
+      const unsigned int *indices = tets[t].particleIndices;
+      const glm::vec4 weights = barycentricWeights(
+          surface.positions[i], positions[indices[0]], positions[indices[1]],
+          positions[indices[2]], positions[indices[3]]);
+      const float depth = std::min(std::min(weights.x, weights.y),
+                                   std::min(weights.z, weights.w));
+      if (depth > bestDepth) {
+        bestDepth = depth;
+        embeddings[i] = {t, weights};
+      }
+    }
+  }
+}
+
+float TetMesh::calculateVolume() const {
+  float volume = 0.0f;
+  for (const auto &tet : tets) {
+    const unsigned int *indices = tet.particleIndices;
+    const float tetVolume6 =
+        tetVolume(positions[indices[0]], positions[indices[1]],
+                  positions[indices[2]], positions[indices[3]]);
+    volume += tet.restVolume < 0.0f ? -tetVolume6 : tetVolume6;
+  }
+  return volume / 6.0f;
+}
+
+float TetMesh::embeddedInvMass(unsigned int i) const {
+  const TetEmbedding &embedding = embeddings[i];
+  const unsigned int *indices = tets[embedding.tetIndex].particleIndices;
+  float invMass = 0.0f;
+  for (int j = 0; j < 4; j++) {
+    const float weight = embedding.weights[j];
+    invMass += weight * weight * invMasses[indices[j]];
+  }
+  return invMass;
+}
+
+void TetMesh::displaceEmbedded(unsigned int i, const glm::vec3 &delta) {
+  const float invMass = embeddedInvMass(i);
+  if (invMass <= 0.0f) {
+    return;
+  }
+
+  // The smallest move of the particles, weighted by their inverse masses,
+  // that moves the embedded point by delta
+  const TetEmbedding &embedding = embeddings[i];
+  const unsigned int *indices = tets[embedding.tetIndex].particleIndices;
+  for (int j = 0; j < 4; j++) {
+    positions[indices[j]] +=
+        delta * (embedding.weights[j] * invMasses[indices[j]] / invMass);
+  }
+}
@@ -0,0 +1,249 @@
+#include "physics/TriangleBVH.hpp"
+
+#include "core/Ray.hpp"
+
+#include "physics/SoftbodyMesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+namespace {
+
+AABB faceBox(const std::vector<glm::vec3> &positions,
+             const SoftbodyFace &face) {
+  const glm::vec3 &a = positions[face.pointMassIndices[0]];
+  const glm::vec3 &b = positions[face.pointMassIndices[1]];
+  const glm::vec3 &c = positions[face.pointMassIndices[2]];
+  return {glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))};
+}
+
+AABB merge(const AABB &a, const AABB &b) {
+  return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+// Entry distance of the ray into the box, infinity if it misses or the box is
+// further than tMax
+float slabTest(const Ray &ray, const AABB &box, float tMax) {
+  const glm::vec3 t1 = (box.min - ray.origin) * ray.invDir;
+  const glm::vec3 t2 = (box.max - ray.origin) * ray.invDir;
+  const glm::vec3 tNear = glm::min(t1, t2);
+  const glm::vec3 tFar = glm::max(t1, t2);
+  const float entry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+  const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+  if (exit < std::max(entry, 0.0f) || entry > tMax) {
+    return std::numeric_limits<float>::infinity();
+  }
+  return entry;
+}
+
+// Faces tested against a ray at once
+constexpr unsigned int FACE_BATCH_SIZE = 4;
+
+// A batch of faces as a structure of arrays, one lane per face. Unused lanes
+// are all zero, a flat face no ray hits.
+struct FaceBatch {
+  float ax[FACE_BATCH_SIZE], ay[FACE_BATCH_SIZE], az[FACE_BATCH_SIZE];
+  float abx[FACE_BATCH_SIZE], aby[FACE_BATCH_SIZE], abz[FACE_BATCH_SIZE];
+  float acx[FACE_BATCH_SIZE], acy[FACE_BATCH_SIZE], acz[FACE_BATCH_SIZE];
+};
+
+// Moller-Trumbore on every lane of the batch without branching, so the loop
+// vectorizes. Writes the t value of each hit or infinity, either side of a
+// face counts.
+void intersectFaces(const Ray &ray, const FaceBatch &batch,
+                    float (&t)[FACE_BATCH_SIZE]) {
+  constexpr float epsilon = 1e-12f;
+  constexpr float miss = std::numeric_limits<float>::infinity();
+  for (unsigned int i = 0; i < FACE_BATCH_SIZE; i++) {
+    // p = dir x ac, det = ab . p
+    const float px = ray.dir.y * batch.acz[i] - ray.dir.z * batch.acy[i];
+    const float py = ray.dir.z * batch.acx[i] - ray.dir.x * batch.acz[i];
+    const float pz = ray.dir.x * batch.acy[i] - ray.dir.y * batch.acx[i];
+    const float det =
+        batch.abx[i] * px + batch.aby[i] * py + batch.abz[i] * pz;
+    const float invDet = 1.0f / det;
+
+    // s = origin - a, q = s x ab
+    const float sx = ray.origin.x - batch.ax[i];
+    const float sy = ray.origin.y - batch.ay[i];
+    const float sz = ray.origin.z - batch.az[i];
+    const float u = (sx * px + sy * py + sz * pz) * invDet;
+    const float qx = sy * batch.abz[i] - sz * batch.aby[i];
+    const float qy = sz * batch.abx[i] - sx * batch.abz[i];
+    const float qz = sx * batch.aby[i] - sy * batch.abx[i];
+    const float v = (ray.dir.x * qx + ray.dir.y * qy + ray.dir.z * qz) * invDet;
+    const float faceT =
+        (batch.acx[i] * qx + batch.acy[i] * qy + batch.acz[i] * qz) * invDet;
+
+    const bool hit = std::fabs(det) >= epsilon && u >= 0.0f && v >= 0.0f &&
+                     u + v <= 1.0f && faceT >= 0.0f;
+    t[i] = hit ? faceT : miss;
+  }
+}
+
+} // namespace
+
+void TriangleBVH::build(const std::vector<glm::vec3> &positions,
+                        const std::vector<SoftbodyFace> &faces) {
+  _nodes.clear();
+  _faceIndices.resize(faces.size());
+  if (faces.empty()) {
+    return;
+  }
+
+  std::vector<glm::vec3> centroids(faces.size());
+  for (unsigned int i = 0; i < faces.size(); i++) {
+    _faceIndices[i] = i;
+    const auto &indices = faces[i].pointMassIndices;
+    centroids[i] = (positions[indices[0]] + positions[indices[1]] +
+                    positions[indices[2]]) /
+                   3.0f;
+  }
+
+  // A binary tree with leaves of at least one face has under 2n nodes
+  _nodes.reserve(2 * faces.size());
+  _nodes.push_back({AABB(), 0, static_cast<unsigned int>(faces.size())});
+
+  // Children are always added after their parent, refit relies on it
+  std::vector<unsigned int> stack = {0};
+  while (!stack.empty()) {
+    const unsigned int nodeIndex = stack.back();
+    stack.pop_back();
+
+    const unsigned int first = _nodes[nodeIndex].first;
+    const unsigned int count = _nodes[nodeIndex].count;
+    if (count <= MAX_LEAF_SIZE) {
+      continue;
+    }
+
+    // Split at the median along the longest axis of the centroid bounds
+    glm::vec3 min = centroids[_faceIndices[first]];
+    glm::vec3 max = min;
+    for (unsigned int i = first; i < first + count; i++) {
+      min = glm::min(min, centroids[_faceIndices[i]]);
+      max = glm::max(max, centroids[_faceIndices[i]]);
+    }
+    const glm::vec3 extent = max - min;
+    int axis = 0;
+    if (extent.y > extent[axis]) {
+      axis = 1;
+    }
+    if (extent.z > extent[axis]) {
+      axis = 2;
+    }
+
+    const unsigned int half = count / 2;
+    auto begin = _faceIndices.begin() + first;
+    std::nth_element(begin, begin + half, begin + count,
+                     [&](unsigned int lhs, unsigned int rhs) {
+                       return centroids[lhs][axis] < centroids[rhs][axis];
+                     });
+
+    const unsigned int left = static_cast<unsigned int>(_nodes.size());
+    _nodes.push_back({AABB(), first, half});
+    _nodes.push_back({AABB(), first + half, count - half});
+    _nodes[nodeIndex].first = left;
+    _nodes[nodeIndex].count = 0;
+    stack.push_back(left);
+    stack.push_back(left + 1);
+  }
+
+  refit(positions, faces);
+}
+
+void TriangleBVH::refit(const std::vector<glm::vec3> &positions,
+                        const std::vector<SoftbodyFace> &faces) {
+  // Walking backwards visits every child before its parent
+  for (size_t i = _nodes.size(); i-- > 0;) {
+    Node &node = _nodes[i];
+    if (node.count == 0) {
+      node.box = merge(_nodes[node.first].box, _nodes[node.first + 1].box);
+      continue;
+    }
+
+    node.box = faceBox(positions, faces[_faceIndices[node.first]]);
+    for (unsigned int j = node.first + 1; j < node.first + node.count; j++) {
+      node.box = merge(node.box, faceBox(positions, faces[_faceIndices[j]]));
+    }
+  }
+}
+
+int TriangleBVH::raycast(const Ray &ray,
+                         const std::vector<glm::vec3> &positions,
+                         const std::vector<SoftbodyFace> &faces,
+                         float &t) const {
+  int hitFace = -1;
+  float closest = std::numeric_limits<float>::infinity();
+  if (_nodes.empty() || !(slabTest(ray, _nodes[0].box, closest) < closest)) {
+    return hitFace;
+  }
+
+  // The depth is logarithmic, 64 entries is plenty
+  unsigned int stack[64];
+  unsigned int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const Node &node = _nodes[stack[--stackSize]];
+    // The closest hit may have moved since the node was pushed
+    if (!(slabTest(ray, node.box, closest) < closest)) {
+      continue;
+    }
+
+    if (node.count > 0) {
+      const unsigned int end = node.first + node.count;
+      for (unsigned int first = node.first; first < end;
+           first += FACE_BATCH_SIZE) {
+        const unsigned int count = std::min(FACE_BATCH_SIZE, end - first);
+        FaceBatch batch = {};
+        for (unsigned int i = 0; i < count; i++) {
+          const auto &indices = faces[_faceIndices[first + i]].pointMassIndices;
+          const glm::vec3 &a = positions[indices[0]];
+          const glm::vec3 ab = positions[indices[1]] - a;
+          const glm::vec3 ac = positions[indices[2]] - a;
+          batch.ax[i] = a.x;
+          batch.ay[i] = a.y;
+          batch.az[i] = a.z;
+          batch.abx[i] = ab.x;
+          batch.aby[i] = ab.y;
+          batch.abz[i] = ab.z;
+          batch.acx[i] = ac.x;
+          batch.acy[i] = ac.y;
+          batch.acz[i] = ac.z;
+        }
+
+        float faceT[FACE_BATCH_SIZE];
+        intersectFaces(ray, batch, faceT);
+        for (unsigned int i = 0; i < count; i++) {
+          if (faceT[i] < closest) {
+            closest = faceT[i];
+            hitFace = static_cast<int>(_faceIndices[first + i]);
+          }
+        }
+      }
+      continue;
+    }
+
+    // Push the further child first so the nearer one is visited first
+    const float leftT = slabTest(ray, _nodes[node.first].box, closest);
+    const float rightT = slabTest(ray, _nodes[node.first + 1].box, closest);
+    const bool leftFirst = leftT <= rightT;
+    const unsigned int nearChild = leftFirst ? node.first : node.first + 1;
+    const unsigned int farChild = leftFirst ? node.first + 1 : node.first;
+    const float farT = std::max(leftT, rightT);
+    const float nearT = std::min(leftT, rightT);
+    if (farT < closest) {
+      stack[stackSize++] = farChild;
+    }
+    if (nearT < closest) {
+      stack[stackSize++] = nearChild;
+    }
+  }
+
+  if (hitFace >= 0) {
+    t = closest;
+  }
+  return hitFace;
+}
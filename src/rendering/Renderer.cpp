@@ -1,6 +1,7 @@
 #include "rendering/Renderer.hpp"
 
 #include "core/Entity.hpp"
+#include "core/Profiler.hpp"
 
 #include "rendering/Window.hpp"
 
@@ -17,7 +18,8 @@ Renderer::Renderer(const Window &window)
 
 void Renderer::renderDebugQuad() const { _depthMap.renderDebugQuad(); }
 
-void Renderer::render(const Entity &rootNode) const {
+void Renderer::render(const Entity &rootNode, float interpolation) const {
+  PROFILE_SCOPE("Renderer::render");
   // Enable depth test and face culling (to fix shadow peter panning)
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
@@ -35,6 +37,7 @@ void Renderer::render(const Entity &rootNode) const {
   // Render depth of scene
   _depthShader.use();
   _depthShader.setMat4("u_LightSpaceMatrix", _light.lightSpaceMatrix);
+  _depthShader.setFloat("u_Interpolation", interpolation);
 
   _depthMap.bind();
   rootNode.draw(_depthShader);
@@ -49,6 +52,7 @@ void Renderer::render(const Entity &rootNode) const {
   _shader.setMat4("u_View", _camera.getViewMatrix());
   _shader.setMat4("u_Projection", _camera.getProjectionMatrix());
   _shader.setMat4("u_LightSpaceMatrix", _light.lightSpaceMatrix);
+  _shader.setFloat("u_Interpolation", interpolation);
   _shader.setVec3("u_ViewPos", _camera.getTransform().getPosition());
   _shader.setFloat("u_Material.shininess", 32.0f);
 
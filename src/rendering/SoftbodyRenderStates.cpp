@@ -0,0 +1,79 @@
+#include "rendering/SoftbodyRenderStates.hpp"
+
+#include <utility>
+
+#include "core/Transform.hpp"
+
+#include "physics/Softbody.hpp"
+
+void SoftbodyRenderStates::simulate(Softbody &softbody, float deltaTime,
+                                    Transform &transform) {
+  // After the first step the buffers lose the state before this one, keep it.
+  // A body that is placed anew jumps, which is not interpolated either.
+  _previousValid = _stepsSinceUpload > 0 && !softbody.isSleeping() &&
+                   transform.getModelMatrix() == glm::mat4(1.0f);
+  if (_previousValid) {
+    _previousPositions = softbody.getMesh().positions;
+  }
+
+  if (!softbody.isSleeping()) {
+    softbody.update(deltaTime, transform);
+    _moved = true;
+  }
+  _stepsSinceUpload++;
+}
+
+unsigned int SoftbodyRenderStates::gather(Softbody &softbody) {
+  if (_stepsSinceUpload == 0) {
+    return 0;
+  }
+
+  // Both buffered states already show the body and it has not moved since
+  if (!_moved && _atRest) {
+    _stepsSinceUpload = 0;
+    return 0;
+  }
+
+  // The previous state in the buffer is only right if exactly one step
+  // moved the body since the last upload
+  unsigned int stateCount = 1;
+  SoftbodyMesh &mesh = softbody.getMesh();
+  if (_moved && _stepsSinceUpload > 1) {
+    stateCount = 2;
+    if (_previousValid) {
+      // Pack the positions before the last step in place of the current ones
+      std::swap(mesh.positions, _previousPositions);
+      softbody.updateNormals();
+      _previous.resize(mesh.pointMassCount());
+      packSoftbodyVertices(mesh, _previous.data());
+      std::swap(mesh.positions, _previousPositions);
+    }
+  }
+  if (_moved) {
+    softbody.updateNormals();
+    _current.resize(mesh.pointMassCount());
+    packSoftbodyVertices(mesh, _current.data());
+  }
+  if (stateCount == 2 && !_previousValid) {
+    _previous = _current;
+  }
+
+  // Uploading the current state on its own, or twice, settles the buffers.
+  // That is how a body that fell asleep comes to rest.
+  _atRest = !_moved || (stateCount == 2 && !_previousValid);
+  _moved = false;
+  _previousValid = false;
+  _stepsSinceUpload = 0;
+  return stateCount;
+}
+
+void SoftbodyRenderStates::reset(const Softbody &softbody) {
+  const SoftbodyMesh &mesh = softbody.getMesh();
+  _current.resize(mesh.pointMassCount());
+  packSoftbodyVertices(mesh, _current.data());
+  _previous = _current;
+  _previousValid = false;
+  _moved = false;
+  _stepsSinceUpload = 0;
+  _atRest = true;
+}
@@ -0,0 +1,61 @@
+#include "rendering/SoftbodyVertex.hpp"
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+
+#include "physics/SoftbodyMesh.hpp"
+
+namespace {
+
+// -1 or 1, never 0, so both halves of the lower pyramid unfold
+float signNotZero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+} // namespace
+
+glm::vec2 encodeOctahedral(const glm::vec3 &normal) {
+  const float l1 =
+      std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if (l1 == 0.0f) {
+    return glm::vec2(0.0f);
+  }
+
+  const glm::vec2 p = glm::vec2(normal.x, normal.y) / l1;
+  if (normal.z >= 0.0f) {
+    return p;
+  }
+
+  // Fold the lower hemisphere over the diagonals
+  return glm::vec2((1.0f - std::abs(p.y)) * signNotZero(p.x),
+                   (1.0f - std::abs(p.x)) * signNotZero(p.y));
+}
+
+glm::vec3 decodeOctahedral(const glm::vec2 &encoded) {
+  glm::vec3 n(encoded.x, encoded.y,
+              1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  const float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return glm::normalize(n);
+}
+
+void packSoftbodyVertices(const SoftbodyMesh &mesh,
+                          SoftbodyVertex *out_vertices) {
+  // Straight passes over the position and normal arrays, written out in
+  // order so the stores stream into write-combined memory
+  const size_t count = mesh.pointMassCount();
+  const glm::vec3 *positions = mesh.positions.data();
+  const glm::vec3 *normals = mesh.normals.data();
+  for (size_t i = 0; i < count; i++) {
+    out_vertices[i].position = positions[i];
+    out_vertices[i].normal = glm::packSnorm2x16(encodeOctahedral(normals[i]));
+  }
+}
+
+void packSoftbodyUVs(const SoftbodyMesh &mesh, std::vector<uint32_t> &out_uvs) {
+  out_uvs.resize(mesh.pointMassCount());
+  for (size_t i = 0; i < out_uvs.size(); i++) {
+    out_uvs[i] = glm::packHalf2x16(mesh.uvs[i]);
+  }
+}
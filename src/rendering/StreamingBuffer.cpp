@@ -0,0 +1,55 @@
+#include "rendering/StreamingBuffer.hpp"
+
+StreamingBuffer::~StreamingBuffer() {
+  for (GLsync fence : _fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (_buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &_buffer);
+  }
+}
+
+void StreamingBuffer::create(size_t regionSize) {
+  _regionSize = regionSize;
+  _region = 0;
+
+  // Immutable storage, so the driver never reallocates it, and coherent, so
+  // writes need no explicit flush
+  const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const GLsizeiptr size = REGION_COUNT * regionSize;
+  glGenBuffers(1, &_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+  glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+  _mapped =
+      static_cast<char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void *StreamingBuffer::nextRegion() {
+  // From now on the draws read the current region and the new one, so every
+  // draw of the previous region has been issued
+  const unsigned int released = (_region + REGION_COUNT - 1) % REGION_COUNT;
+  if (_fences[released]) {
+    glDeleteSync(_fences[released]);
+  }
+  _fences[released] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  _region = (_region + 1) % REGION_COUNT;
+  GLsync fence = _fences[_region];
+  if (fence) {
+    // Usually already signaled, the fence is several steps old
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) ==
+           GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(fence);
+    _fences[_region] = nullptr;
+  }
+
+  return _mapped + getOffset();
+}
@@ -2,7 +2,10 @@
 
 #include <glad/glad.h>
 
+#include <cstring>
+
 #include "rendering/MeshVertex.hpp"
+#include "rendering/SoftbodyVertex.hpp"
 
 VertexBufferLayout::~VertexBufferLayout() {
   glDeleteVertexArrays(1, &_vao);
@@ -63,46 +66,85 @@ void VertexBufferLayout::createBufferLayout(
   glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
                         (void *)offsetof(MeshVertex, bitangent));
 
+  // previous position and normal, the same since the mesh never moves
+  glEnableVertexAttribArray(5);
+  glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                        (void *)offsetof(MeshVertex, position));
+  glEnableVertexAttribArray(6);
+  glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                        (void *)offsetof(MeshVertex, normal));
+
   glBindVertexArray(0);
 }
 
 void VertexBufferLayout::createSoftBodyBufferLayout(
-    std::vector<PointMass> &vertices, std::vector<SoftbodyFace> &faces) {
+    const std::vector<SoftbodyVertex> &vertices,
+    const std::vector<uint32_t> &uvs, const std::vector<SoftbodyFace> &faces) {
   // Set up VAO, VBO, EBO
   glGenVertexArrays(1, &_vao);
   glBindVertexArray(_vao);
 
   glGenBuffers(1, &_vbo);
   glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PointMass),
-               vertices.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(uint32_t), uvs.data(),
+               GL_STATIC_DRAW);
 
   glGenBuffers(1, &_ebo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(SoftbodyFace),
                faces.data(), GL_STATIC_DRAW);
 
+  _stream.create(vertices.size() * sizeof(SoftbodyVertex));
+
+  // Binding 0 is the newest streamed vertices, binding 1 the static uvs and
+  // binding 2 the streamed vertices of the step before
   // position
   glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PointMass),
-                        (void *)offsetof(PointMass, position));
+  glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE,
+                       offsetof(SoftbodyVertex, position));
+  glVertexAttribBinding(0, 0);
 
   // uv
   glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(PointMass),
-                        (void *)offsetof(PointMass, uv));
+  glVertexAttribFormat(1, 2, GL_HALF_FLOAT, GL_FALSE, 0);
+  glVertexAttribBinding(1, 1);
+  glBindVertexBuffer(1, _vbo, 0, sizeof(uint32_t));
 
-  // normal
+  // normal, decoded in the vertex shader
   glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(PointMass),
-                        (void *)offsetof(PointMass, normal));
+  glVertexAttribFormat(2, 2, GL_SHORT, GL_TRUE,
+                       offsetof(SoftbodyVertex, normal));
+  glVertexAttribBinding(2, 0);
+
+  // previous position
+  glEnableVertexAttribArray(5);
+  glVertexAttribFormat(5, 3, GL_FLOAT, GL_FALSE,
+                       offsetof(SoftbodyVertex, position));
+  glVertexAttribBinding(5, 2);
+
+  // previous normal
+  glEnableVertexAttribArray(6);
+  glVertexAttribFormat(6, 2, GL_SHORT, GL_TRUE,
+                       offsetof(SoftbodyVertex, normal));
+  glVertexAttribBinding(6, 2);
 
   glBindVertexArray(0);
+
+  // Fill two regions, so there is a previous state from the start
+  updateSoftBodyBufferLayout(vertices);
+  updateSoftBodyBufferLayout(vertices);
 }
 
 void VertexBufferLayout::updateSoftBodyBufferLayout(
-    std::vector<PointMass> &vertices, std::vector<SoftbodyFace> &faces) {
-  glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PointMass),
-               vertices.data(), GL_STATIC_DRAW);
+    const std::vector<SoftbodyVertex> &vertices) {
+  void *region = _stream.nextRegion();
+  std::memcpy(region, vertices.data(),
+              vertices.size() * sizeof(SoftbodyVertex));
+
+  glBindVertexArray(_vao);
+  glBindVertexBuffer(0, _stream.getBuffer(), _stream.getOffset(),
+                     sizeof(SoftbodyVertex));
+  glBindVertexBuffer(2, _stream.getBuffer(), _stream.getPreviousOffset(),
+                     sizeof(SoftbodyVertex));
+  glBindVertexArray(0);
 }
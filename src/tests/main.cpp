@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+
+#include "core/MeshGenerator.hpp"
+#include "core/ObjLoader.hpp"
+#include "core/Transform.hpp"
+
+#include "physics/Softbody.hpp"
+#include "physics/SoftbodyMesh.hpp"
+#include "physics/SoftbodyMeshCache.hpp"
+
+#include "rendering/SoftbodyRenderStates.hpp"
+#include "rendering/SoftbodyVertex.hpp"
+
+namespace {
+
+int failures = 0;
+
+// Reports a failed check without stopping the test, so one run lists them all
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition        \
+                << ") failed\n";                                               \
+      failures++;                                                              \
+    }                                                                          \
+  } while (false)
+
+// Writes contents to a file in the temporary directory, returns its path
+std::string writeTempFile(const std::string &name,
+                          const std::string &contents) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+  return path;
+}
+
+// Loads obj text through a temporary file
+Mesh loadObjText(const std::string &text,
+                 VertexWeld weld = VertexWeld::ALL_ATTRIBUTES) {
+  const std::string path = writeTempFile("loader_test.obj", text);
+  Mesh mesh;
+  try {
+    ObjLoader::loadMesh(path, mesh, weld);
+  } catch (...) {
+    std::remove(path.c_str());
+    throw;
+  }
+  std::remove(path.c_str());
+  return mesh;
+}
+
+// A closed tetrahedron
+const char *const TETRAHEDRON_OBJ = "v 0 0 0\n"
+                                    "v 1 0 0\n"
+                                    "v 0 1 0\n"
+                                    "v 0 0 1\n"
+                                    "f 1 3 2\n"
+                                    "f 1 2 4\n"
+                                    "f 1 4 3\n"
+                                    "f 2 3 4\n";
+
+// A mesh with uvs and normals all over the sphere, the poles included
+SoftbodyMesh testMesh() {
+  SoftbodyMesh mesh(MeshGenerator::generateCube());
+  const glm::vec3 normals[] = {
+      {0.0f, 0.0f, 1.0f},  {0.0f, 0.0f, -1.0f}, {0.0f, 1e-4f, -1.0f},
+      {-1.0f, 0.0f, 0.0f}, {0.6f, -0.8f, 0.0f}, {0.48f, -0.6f, -0.64f},
+  };
+  for (size_t i = 0; i < mesh.pointMassCount(); i++) {
+    const glm::vec3 normal = i < std::size(normals)
+                                 ? normals[i]
+                                 : mesh.positions[i] - glm::vec3(0.1f);
+    mesh.normals[i] = glm::normalize(normal);
+  }
+  return mesh;
+}
+
+void testOctahedralRoundTrip() {
+  const SoftbodyMesh mesh = testMesh();
+  std::vector<SoftbodyVertex> vertices(mesh.pointMassCount());
+  packSoftbodyVertices(mesh, vertices.data());
+
+  for (size_t i = 0; i < vertices.size(); i++) {
+    CHECK(vertices[i].position == mesh.positions[i]);
+    // snorm16 steps are 1/32767, the decode error stays well below 1e-3
+    const glm::vec3 decoded =
+        decodeOctahedral(glm::unpackSnorm2x16(vertices[i].normal));
+    CHECK(glm::length(decoded - mesh.normals[i]) < 1e-3f);
+  }
+}
+
+void testHalfFloatUVs() {
+  SoftbodyMesh mesh = testMesh();
+  // Corners without a uv are stored as -1
+  mesh.uvs[0] = glm::vec2(-1.0f);
+  std::vector<uint32_t> uvs;
+  packSoftbodyUVs(mesh, uvs);
+
+  CHECK(uvs.size() == mesh.pointMassCount());
+  for (size_t i = 0; i < uvs.size(); i++) {
+    // Half floats keep 11 significant bits
+    const glm::vec2 unpacked = glm::unpackHalf2x16(uvs[i]);
+    const glm::vec2 tolerance =
+        glm::max(glm::abs(mesh.uvs[i]), glm::vec2(1.0f)) / 2048.0f;
+    CHECK(glm::all(glm::lessThanEqual(glm::abs(unpacked - mesh.uvs[i]),
+                                      tolerance)));
+  }
+}
+
+bool samePositions(const std::vector<SoftbodyVertex> &vertices,
+                   const std::vector<glm::vec3> &positions) {
+  if (vertices.size() != positions.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < positions.size(); i++) {
+    if (vertices[i].position != positions[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void testInterpolationStates() {
+  Softbody softbody(MeshGenerator::generateCube());
+  softbody.setSleepingEnabled(false);
+  Transform transform;
+  transform.setPosition(0.0f, 2.0f, 0.0f);
+  transform.computeModelMatrix();
+  const float deltaTime = 1.0f / 60.0f;
+
+  SoftbodyRenderStates states;
+  states.reset(softbody);
+  states.simulate(softbody, deltaTime, transform);
+  CHECK(states.gather(softbody) == 1);
+  CHECK(samePositions(states.current(), softbody.getMesh().positions));
+
+  // Two steps before one upload, the buffers need the state after each
+  states.simulate(softbody, deltaTime, transform);
+  const std::vector<glm::vec3> beforeLastStep = softbody.getMesh().positions;
+  states.simulate(softbody, deltaTime, transform);
+  CHECK(states.gather(softbody) == 2);
+  CHECK(samePositions(states.previous(), beforeLastStep));
+  CHECK(samePositions(states.current(), softbody.getMesh().positions));
+  CHECK(!samePositions(states.previous(), softbody.getMesh().positions));
+
+  // Nothing simulated, nothing to upload
+  CHECK(states.gather(softbody) == 0);
+}
+
+// The position of every index, three per triangle
+std::vector<glm::vec3> trianglePositions(const Mesh &mesh) {
+  std::vector<glm::vec3> positions;
+  for (unsigned int index : mesh._indices) {
+    positions.push_back(mesh._vertices[index].position);
+  }
+  return positions;
+}
+
+bool throwsOnLoad(const std::string &text) {
+  try {
+    loadObjText(text);
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+void testObjFanTriangulation() {
+  const Mesh mesh = loadObjText("v 0 0 0\n"
+                                "v 1 0 0\n"
+                                "v 1 1 0\n"
+                                "v 0 1 0\n"
+                                "v -1 1 0\n"
+                                "f 1 2 3 4 5\n");
+  const std::vector<glm::vec3> expected = {
+      {0, 0, 0}, {1, 0, 0}, {1, 1, 0},  // 1 2 3
+      {0, 0, 0}, {1, 1, 0}, {0, 1, 0},  // 1 3 4
+      {0, 0, 0}, {0, 1, 0}, {-1, 1, 0}, // 1 4 5
+  };
+  CHECK(trianglePositions(mesh) == expected);
+  CHECK(mesh._vertices.size() == 5);
+}
+
+void testObjNegativeIndices() {
+  // Relative to the elements seen so far, not to the whole file
+  const Mesh mesh = loadObjText("v 0 0 0\n"
+                                "v 1 0 0\n"
+                                "v 0 1 0\n"
+                                "f -3 -2 -1\n"
+                                "v 0 0 1\n"
+                                "f 1 -3 -1\n");
+  const std::vector<glm::vec3> expected = {
+      {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 0}, {1, 0, 0}, {0, 0, 1},
+  };
+  CHECK(trianglePositions(mesh) == expected);
+}
+
+void testObjCornerFormats() {
+  const Mesh normalsOnly = loadObjText("v 0 0 0\n"
+                                       "v 1 0 0\n"
+                                       "v 0 1 0\n"
+                                       "vn 0 0 1\n"
+                                       "f 1//1 2//1 3//1\n");
+  CHECK(normalsOnly._vertices.size() == 3);
+  for (const MeshVertex &vertex : normalsOnly._vertices) {
+    CHECK(vertex.normal == glm::vec3(0, 0, 1));
+    // Corners without a uv get -1
+    CHECK(vertex.uv == glm::vec2(-1, -1));
+  }
+
+  const Mesh uvsOnly = loadObjText("v 0 0 0\n"
+                                   "v 1 0 0\n"
+                                   "v 0 1 0\n"
+                                   "vt 0 0\n"
+                                   "vt 1 0\n"
+                                   "vt 0 1\n"
+                                   "f 1/1 2/2 3/3\n");
+  CHECK(uvsOnly._vertices.size() == 3);
+  CHECK(uvsOnly._indices.size() == 3);
+  for (unsigned int index : uvsOnly._indices) {
+    const MeshVertex &vertex = uvsOnly._vertices[index];
+    CHECK(vertex.uv == glm::vec2(vertex.position));
+    CHECK(vertex.normal == glm::vec3(0, 0, 0));
+  }
+}
+
+void testObjErrorsThrow() {
+  const std::string triangle = "v 0 0 0\nv 1 0 0\nv 0 1 0\n";
+  CHECK(!throwsOnLoad(triangle + "f 1 2 3\n"));
+  CHECK(throwsOnLoad(triangle + "v 1 zero 0\nf 1 2 3\n"));
+  CHECK(throwsOnLoad(triangle + "f 1 2\n"));
+  CHECK(throwsOnLoad(triangle + "f 1 2 4\n"));
+  CHECK(throwsOnLoad(triangle + "f 1 2 -4\n"));
+  CHECK(throwsOnLoad(triangle + "vt 0 0\nf 1/1 2/2 3/1\n"));
+}
+
+void testWeldUVSeam() {
+  // Two triangles sharing the edge 1-2, split by a uv and normal seam
+  const std::string seam = "v 0 0 0\n"
+                           "v 1 0 0\n"
+                           "v 0 1 0\n"
+                           "v 0 -1 0\n"
+                           "vt 0 0\n"
+                           "vt 1 0\n"
+                           "vt 0.5 0.5\n"
+                           "vt 0.25 0\n"
+                           "vt 0.75 0\n"
+                           "vn 0 0 1\n"
+                           "vn 1 0 0\n"
+                           "f 1/1/1 2/2/1 3/3/1\n"
+                           "f 2/5/2 1/4/2 4/3/2\n";
+  CHECK(loadObjText(seam)._vertices.size() == 6);
+
+  const Mesh welded = loadObjText(seam, VertexWeld::POSITION_ONLY);
+  CHECK(welded._vertices.size() == 4);
+  CHECK(welded._indices.size() == 6);
+  const glm::vec3 averaged = glm::normalize(glm::vec3(1, 0, 1));
+  for (unsigned int i : {welded._indices[0], welded._indices[1]}) {
+    // The seam keeps the uv of its first corner
+    CHECK(welded._vertices[i].uv ==
+          (i == welded._indices[0] ? glm::vec2(0, 0) : glm::vec2(1, 0)));
+    CHECK(glm::length(welded._vertices[i].normal - averaged) < 1e-6f);
+  }
+  CHECK(welded._vertices[welded._indices[2]].normal == glm::vec3(0, 0, 1));
+  CHECK(welded._vertices[welded._indices[5]].normal == glm::vec3(1, 0, 0));
+}
+
+void testWeldNegativeZero() {
+  const Mesh mesh = loadObjText("v 0 0 0\n"
+                                "v 1 0 0\n"
+                                "v 0 1 0\n"
+                                "v -0 -0.0 0\n"
+                                "vn 0 0 1\n"
+                                "vn -0 0 1\n"
+                                "f 1//1 2//1 3//1\n"
+                                "f 4//2 3//1 2//1\n");
+  CHECK(mesh._vertices.size() == 3);
+  CHECK(mesh._indices.size() == 6 && mesh._indices[3] == mesh._indices[0]);
+}
+
+void testWeldAcrossBucketEdge() {
+  // The shared corner at x = 4.9e-6 and 5.1e-6 rounds to different 1e-5
+  // buckets, but is the same point
+  const Mesh mesh = loadObjText("v 0.0000049 0 0\n"
+                                "v 1 0 0\n"
+                                "v 0 1 0\n"
+                                "v 0.0000051 0 0\n"
+                                "v 0 -1 0\n"
+                                "f 1 2 3\n"
+                                "f 4 5 2\n",
+                                VertexWeld::POSITION_ONLY);
+  CHECK(mesh._vertices.size() == 4);
+  CHECK(mesh._indices.size() == 6 && mesh._indices[3] == mesh._indices[0]);
+
+  // Further apart than the bucket size, they stay separate
+  const Mesh apart = loadObjText("v 0 0 0\n"
+                                 "v 1 0 0\n"
+                                 "v 0 1 0\n"
+                                 "v 0.00002 0 0\n"
+                                 "f 1 2 3\n"
+                                 "f 4 2 3\n",
+                                 VertexWeld::POSITION_ONLY);
+  CHECK(apart._vertices.size() == 4);
+}
+
+void testMeshCacheRejectsCorruptMeshes() {
+  const std::string path = writeTempFile("cache_test.obj", TETRAHEDRON_OBJ);
+  SoftbodyMesh mesh;
+  std::vector<std::string> materialFiles;
+  SoftbodyMeshCache::loadOrBuild(path, mesh, materialFiles);
+  SoftbodyMesh loaded;
+  CHECK(SoftbodyMeshCache::load(path, loaded, materialFiles));
+  CHECK(loaded.edges.size() == mesh.edges.size());
+
+  // Each of these would index out of bounds in the solver
+  const std::function<void(SoftbodyMesh &)> corruptions[] = {
+      [](SoftbodyMesh &m) { m.faces[0].pointMassIndices[1] = 100; },
+      [](SoftbodyMesh &m) { m.edges[0].pointMassIndices[0] = 100; },
+      [](SoftbodyMesh &m) { m.edges[1].faceIndices[1] = 100; },
+      [](SoftbodyMesh &m) { m.edges[2].neighborIndices[1] = 100; },
+      [](SoftbodyMesh &m) { m.halfEdges.twins[3] = 100; },
+      [](SoftbodyMesh &m) { m.halfEdges.twins.pop_back(); },
+      [](SoftbodyMesh &m) { m.halfEdges.edgeIndices[0] = 100; },
+      [](SoftbodyMesh &m) { m.halfEdges.edgeHalfEdges[0] = 100; },
+      [](SoftbodyMesh &m) { m.lengthColoring.constraintIndices[0] = 100; },
+      [](SoftbodyMesh &m) { m.spanColoring.colorOffsets.back() += 1; },
+      [](SoftbodyMesh &m) {
+        std::vector<unsigned int> &offsets = m.lengthColoring.colorOffsets;
+        std::swap(offsets[0], offsets[1]);
+      },
+  };
+  for (const auto &corrupt : corruptions) {
+    SoftbodyMesh corrupted = mesh;
+    corrupt(corrupted);
+    CHECK(SoftbodyMeshCache::save(path, corrupted, materialFiles));
+    CHECK(!SoftbodyMeshCache::load(path, loaded, materialFiles));
+  }
+
+  std::remove(SoftbodyMeshCache::cachePath(path).c_str());
+  std::remove(path.c_str());
+}
+
+void testObjLeadingPlus() {
+  const Mesh mesh = loadObjText("v +1.5 0 -0.5\n"
+                                "v 0 +2e+0 0\n"
+                                "v 0 0 1\n"
+                                "f +1 2 +3\n");
+  CHECK(mesh._indices.size() == 3);
+  CHECK(mesh._vertices.size() == 3);
+  CHECK(mesh._vertices[0].position == glm::vec3(1.5f, 0.0f, -0.5f));
+  CHECK(mesh._vertices[1].position == glm::vec3(0.0f, 2.0f, 0.0f));
+}
+
+} // namespace
+
+int main() {
+  const struct {
+    const char *name;
+    void (*run)();
+  } tests[] = {
+      {"octahedral_round_trip", testOctahedralRoundTrip},
+      {"half_float_uvs", testHalfFloatUVs},
+      {"interpolation_states", testInterpolationStates},
+      {"obj_fan_triangulation", testObjFanTriangulation},
+      {"obj_negative_indices", testObjNegativeIndices},
+      {"obj_corner_formats", testObjCornerFormats},
+      {"obj_errors_throw", testObjErrorsThrow},
+      {"obj_leading_plus", testObjLeadingPlus},
+      {"weld_uv_seam", testWeldUVSeam},
+      {"weld_negative_zero", testWeldNegativeZero},
+      {"weld_across_bucket_edge", testWeldAcrossBucketEdge},
+      {"mesh_cache_rejects_corrupt_meshes",
+       testMeshCacheRejectsCorruptMeshes},
+  };
+
+  for (const auto &test : tests) {
+    const int failuresBefore = failures;
+    try {
+      test.run();
+    } catch (const std::exception &e) {
+      std::cerr << test.name << " threw: " << e.what() << "\n";
+      failures++;
+    }
+    std::cout << (failures == failuresBefore ? "PASS " : "FAIL ") << test.name
+              << "\n";
+  }
+  return failures == 0 ? 0 : 1;
+}